@@ -1,52 +1,66 @@
 #include "Board.h"
+#include "Evaluation.h"
+
+__forceinline void BoardState::addPieceScore(uint8_t piece, Square sq)
+{
+    score += Evaluation::pieceSquareTable[piece][sq];
+    phase += Evaluation::phaseWeight[piece];
+}
+
+__forceinline void BoardState::removePieceScore(uint8_t piece, Square sq)
+{
+    score -= Evaluation::pieceSquareTable[piece][sq];
+    phase -= Evaluation::phaseWeight[piece];
+}
+
+void BoardState::computeScores()
+{
+    score = Evaluation::sumPieceSquares(*this);
+
+    phase = 0;
+    for (Square sq = 0; sq < 64; ++sq)
+    {
+        if (mailbox[sq] != Piece::NONE) phase += Evaluation::phaseWeight[mailbox[sq]];
+    }
+}
+
+__forceinline void BoardState::togglePawnKey(const Move& move, uint8_t capturedPiece, Square capturedSquare)
+{
+    // Black pawns use the randoms 0-63, white pawns 64-127
+    if (capturedPiece == Piece::WP || capturedPiece == Piece::BP)
+        pawnKey ^= Random64[(capturedPiece == Piece::WP ? 64 : 0) + capturedSquare];
+
+    if (move.piece == Piece::WP || move.piece == Piece::BP)
+    {
+        int offset = move.piece == Piece::WP ? 64 : 0;
+        pawnKey ^= Random64[offset + move.startSquare];
+        if (move.promotedPiece == Piece::NONE) pawnKey ^= Random64[offset + move.endSquare];
+    }
+}
 
 void BoardState::makeMove(const Move& move) {
     History history;
     // Save current state
     history.move = move;
     history.prevCastlingRights = castlingRights;
-    history.prevEnPassant = enPassant;
+    history.prevEnPassantFile = enPassant ? SquareOf(enPassant) % 8 : NO_EN_PASSANT;
     history.prevHalfmoveClock = halfmoveClock;
     history.prevFullmoveNumber = fullmoveNumber;
     history.capturedPiece = Piece::NONE;
     history.capturedSquare = 0;
-    history.rookFrom = 0;
-    history.rookTo = 0;
     history.prevZobristKey = zobristKey;
+    history.prevScore = score;
+    history.prevPhase = phase;
 
     if (enPassant) zobristKey ^= Random64[772 + (SquareOf(enPassant) % 8)];
 
     // Handle captures
     if (move.captureFlag) 
     {
-        if (move.enpassantFlag) 
-        {
-            history.capturedSquare = whiteTurn ? move.endSquare + 8 : move.endSquare - 8;
-            history.capturedPiece = whiteTurn ? Piece::BP : Piece::WP;
-        } 
-        else 
-        {
-            history.capturedSquare = move.endSquare;
-            Bitboard target = 1ULL << move.endSquare;
-            if (whiteTurn) 
-            {
-                if (blackPawns   & target) history.capturedPiece = Piece::BP;
-                else if (blackKnights & target) history.capturedPiece = Piece::BN;
-                else if (blackBishops & target) history.capturedPiece = Piece::BB;
-                else if (blackRooks   & target) history.capturedPiece = Piece::BR;
-                else if (blackQueens  & target) history.capturedPiece = Piece::BQ;
-                else if (blackKing    & target) history.capturedPiece = Piece::BK;
-            } 
-            else 
-            {
-                if (whitePawns   & target) history.capturedPiece = Piece::WP;
-                else if (whiteKnights & target) history.capturedPiece = Piece::WN;
-                else if (whiteBishops & target) history.capturedPiece = Piece::WB;
-                else if (whiteRooks   & target) history.capturedPiece = Piece::WR;
-                else if (whiteQueens  & target) history.capturedPiece = Piece::WQ;
-                else if (whiteKing    & target) history.capturedPiece = Piece::WK;
-            }
-        }
+        history.capturedSquare = move.enpassantFlag ? (whiteTurn ? move.endSquare + 8 : move.endSquare - 8) : move.endSquare;
+        history.capturedPiece = mailbox[history.capturedSquare];
+        mailbox[history.capturedSquare] = Piece::NONE;
+        removePieceScore(history.capturedPiece, history.capturedSquare);
         // Remove captured piece
         switch (history.capturedPiece) 
         {
@@ -92,46 +106,35 @@ void BoardState::makeMove(const Move& move) {
     // Handle castling
     if (move.castlingFlag) 
     {
-        // Determine rook's movement based on destination square.
-        if (whiteTurn) 
-        {
-            if (move.endSquare == 62) 
-            { // White kingside castling.
-                history.rookFrom = 63; history.rookTo = 61;
-            }
-            else 
-            { // White queenside castling.
-                history.rookFrom = 56; history.rookTo = 59;
-            }
-        } 
-        else 
-        {
-            if (move.endSquare == 6) 
-            { // Black kingside castling.
-                history.rookFrom = 7; history.rookTo = 5;
-            }
-            else 
-            { // Black queenside castling.
-                history.rookFrom = 0; history.rookTo = 3;
-            }
-        }
+        Square rookFrom, rookTo;
+        castlingRookSquares(move, rookFrom, rookTo);
+
         // Move the rook.
-        Bitboard rookBB = (1ULL << history.rookFrom) | (1ULL << history.rookTo);
+        Bitboard rookBB = (1ULL << rookFrom) | (1ULL << rookTo);
         if (whiteTurn)
             whiteRooks ^= rookBB;
         else
             blackRooks ^= rookBB;
 
+        mailbox[rookTo] = mailbox[rookFrom];
+        mailbox[rookFrom] = Piece::NONE;
+        removePieceScore(mailbox[rookTo], rookFrom);
+        addPieceScore(mailbox[rookTo], rookTo);
+
         int rookColor = whiteTurn ? 0 : 1;
         int rookType = 3; // Rook
         int rookIndex = (rookType * 2) + (1 - rookColor);
-        zobristKey ^= Random64[rookIndex * 64 + history.rookFrom];
-        zobristKey ^= Random64[rookIndex * 64 + history.rookTo];
+        zobristKey ^= Random64[rookIndex * 64 + rookFrom];
+        zobristKey ^= Random64[rookIndex * 64 + rookTo];
     }
 
     // Move the piece
     Bitboard fromBB = 1ULL << move.startSquare;
     Bitboard toBB   = 1ULL << move.endSquare;
+    mailbox[move.startSquare] = Piece::NONE;
+    mailbox[move.endSquare] = move.promotedPiece != Piece::NONE ? move.promotedPiece : move.piece;
+    removePieceScore(move.piece, move.startSquare);
+    addPieceScore(mailbox[move.endSquare], move.endSquare);
     switch (move.piece) {
         // White pieces.
         case Piece::WP: whitePawns   ^= fromBB | toBB; break;
@@ -245,6 +248,8 @@ void BoardState::makeMove(const Move& move) {
         zobristKey ^= Random64[772 + file];
     }
 
+    togglePawnKey(move, history.capturedPiece, history.capturedSquare);
+
     // Update clocks
     halfmoveClock = (move.captureFlag || move.piece == Piece::WP || move.piece == Piece::BP) ? 0 : halfmoveClock + 1;
     if (!whiteTurn) fullmoveNumber++;
@@ -260,13 +265,14 @@ void BoardState::makeMove(const Move& move) {
 
 void BoardState::unmakeMove() {
     if (historyStack.empty()) return;
-    History history = historyStack.back();
-    historyStack.pop_back();
+    const History& history = historyStack.back();
     const Move& move = history.move;
 
     // Revert the moving piece
     Bitboard fromBB = 1ULL << move.startSquare;
     Bitboard toBB   = 1ULL << move.endSquare;
+    mailbox[move.startSquare] = move.piece;
+    mailbox[move.endSquare] = Piece::NONE;
     switch (move.piece) {
         // White pieces.
         case Piece::WP: whitePawns   ^= fromBB | toBB; break;
@@ -312,6 +318,7 @@ void BoardState::unmakeMove() {
     // Restore captured piece (if any)
     if (history.capturedPiece != Piece::NONE) {
         Bitboard capturedBB = 1ULL << history.capturedSquare;
+        mailbox[history.capturedSquare] = history.capturedPiece;
         switch (history.capturedPiece) {
             // Black pieces restored (captured by white)
             case Piece::BP: blackPawns   |= capturedBB; break;
@@ -331,21 +338,75 @@ void BoardState::unmakeMove() {
 
     // Revert castling: if a castling move was made, move the rook back.
     if (move.castlingFlag) {
-        Bitboard rookBB = (1ULL << history.rookFrom) | (1ULL << history.rookTo);
+        Square rookFrom, rookTo;
+        castlingRookSquares(move, rookFrom, rookTo);
+
+        Bitboard rookBB = (1ULL << rookFrom) | (1ULL << rookTo);
         // Use the movers color (extracted from move.piece) to decide which rook bitboard to update.
         if ((move.piece & Piece::COLOR_MASK) == 0) // White moved.
             whiteRooks ^= rookBB;
         else
             blackRooks ^= rookBB;
+
+        mailbox[rookFrom] = mailbox[rookTo];
+        mailbox[rookTo] = Piece::NONE;
     }
 
+    togglePawnKey(move, history.capturedPiece, history.capturedSquare);
+
     // Restore previous state variables.
+    whiteTurn       = !whiteTurn; // Revert turn.
     zobristKey = history.prevZobristKey;
+    score = history.prevScore;
+    phase = history.prevPhase;
     castlingRights = history.prevCastlingRights;
-    enPassant       = history.prevEnPassant;
+    enPassant       = enPassantFromFile(history.prevEnPassantFile);
     halfmoveClock   = history.prevHalfmoveClock;
     fullmoveNumber  = history.prevFullmoveNumber;
-    whiteTurn       = !whiteTurn; // Revert turn.
+
+    historyStack.pop_back();
+}
+
+// Passes the turn without moving anything, only the search uses this (null move pruning)
+void BoardState::makeNullMove()
+{
+    History history;
+    history.move = Move{};
+    history.prevCastlingRights = castlingRights;
+    history.prevEnPassantFile = enPassant ? SquareOf(enPassant) % 8 : NO_EN_PASSANT;
+    history.prevHalfmoveClock = halfmoveClock;
+    history.prevFullmoveNumber = fullmoveNumber;
+    history.capturedPiece = Piece::NONE;
+    history.capturedSquare = 0;
+    history.prevZobristKey = zobristKey;
+    history.prevScore = score;
+    history.prevPhase = phase;
+
+    // The en passant capture is only available for one move
+    if (enPassant) zobristKey ^= Random64[772 + (SquareOf(enPassant) % 8)];
+    enPassant = 0;
+
+    halfmoveClock++;
+    if (!whiteTurn) fullmoveNumber++;
+
+    whiteTurn = !whiteTurn;
+    zobristKey ^= Random64[780];
+
+    historyStack.push_back(history);
+}
+
+void BoardState::unmakeNullMove()
+{
+    if (historyStack.empty()) return;
+    const History& history = historyStack.back();
+
+    whiteTurn       = !whiteTurn;
+    zobristKey      = history.prevZobristKey;
+    enPassant       = enPassantFromFile(history.prevEnPassantFile);
+    halfmoveClock   = history.prevHalfmoveClock;
+    fullmoveNumber  = history.prevFullmoveNumber;
+
+    historyStack.pop_back();
 }
 
 
@@ -363,6 +424,8 @@ void BoardState::parseFEN(const std::string& fen)
     enPassant = 0;
     halfmoveClock = 0;
     fullmoveNumber = 1;
+    historyStack.clear();
+    mailbox.fill(Piece::NONE);
 
     size_t idx = 0;
     int rank = 0;  // 0 for 8th rank, 7 for 1st rank
@@ -397,19 +460,22 @@ void BoardState::parseFEN(const std::string& fen)
             int square = rank * 8 + file;
             bool isWhite = isupper(c);
             Bitboard mask = 1ULL << square;
+            uint8_t color = isWhite ? 0 : 1;
             switch (tolower(c)) 
             {
-                case 'p': isWhite ? whitePawns |= mask : blackPawns |= mask; break;
-                case 'n': isWhite ? whiteKnights |= mask : blackKnights |= mask; break;
-                case 'b': isWhite ? whiteBishops |= mask : blackBishops |= mask; break;
-                case 'r': isWhite ? whiteRooks |= mask : blackRooks |= mask; break;
-                case 'q': isWhite ? whiteQueens |= mask : blackQueens |= mask; break;
-                case 'k': isWhite ? whiteKing |= mask : blackKing |= mask; break;
+                case 'p': isWhite ? whitePawns |= mask : blackPawns |= mask; mailbox[square] = Piece::make(color, 0); break;
+                case 'n': isWhite ? whiteKnights |= mask : blackKnights |= mask; mailbox[square] = Piece::make(color, 1); break;
+                case 'b': isWhite ? whiteBishops |= mask : blackBishops |= mask; mailbox[square] = Piece::make(color, 2); break;
+                case 'r': isWhite ? whiteRooks |= mask : blackRooks |= mask; mailbox[square] = Piece::make(color, 3); break;
+                case 'q': isWhite ? whiteQueens |= mask : blackQueens |= mask; mailbox[square] = Piece::make(color, 4); break;
+                case 'k': isWhite ? whiteKing |= mask : blackKing |= mask; mailbox[square] = Piece::make(color, 5); break;
             }
             file++;
         }
     }
 
+    computeScores();
+
     // Parse active color
     whiteTurn = true;
     if (++idx < fen.size()) {
@@ -472,6 +538,7 @@ void BoardState::parseFEN(const std::string& fen)
 
 
     zobristKey = computeZobristHash(*this);
+    pawnKey = computePawnHash(*this);
 }
 
 // Todo: test if this even works - It's never been used
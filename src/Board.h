@@ -10,8 +10,10 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <algorithm>
 
 #include "Zobrist.h"
+#include "Score.h"
 
 typedef uint64_t Bitboard;
 typedef uint64_t Square;
@@ -156,20 +158,71 @@ struct BoardStatus {
 
 struct BoardState
 {
+	static constexpr uint8_t NO_EN_PASSANT = 8;
+
+	// Everything unmakeMove can't recompute cheaply, packed into 32 bytes. The castling rook squares follow from the king's move
+	// and the en passant square from its file and the side to move
 	struct History 
 	{
+		uint64_t prevZobristKey;    // The old zobrist hash for the position
 		Move move;                  // The move made
-		uint8_t capturedPiece;      // Type of captured piece (Piece::NONE if none)
-		Square capturedSquare;      // Where the capture occurred (if any)
-		uint8_t prevCastlingRights; // Castling rights before the move
-		Bitboard prevEnPassant;     // En passant state before the move
 		uint16_t prevHalfmoveClock; // Halfmove clock before the move
 		uint16_t prevFullmoveNumber;// Fullmove number before the move
-		Square rookFrom;            // Rook's original square (castling)
-		Square rookTo;              // Rook's new square (castling)
-		uint64_t prevZobristKey; // The old zobrist hash for the position
+		Score prevScore;            // Incremental evaluation sums before the move
+		uint8_t prevPhase;
+		uint8_t capturedPiece;      // Type of captured piece (Piece::NONE if none)
+		uint8_t capturedSquare;     // Where the capture occurred (if any)
+		uint8_t prevCastlingRights; // Castling rights before the move
+		uint8_t prevEnPassantFile;  // File of the en passant square before the move, NO_EN_PASSANT if there was none
 	};	
 
+	// Fixed capacity stack of History records stored inline in the board, so making a move never allocates.
+	// Copies only copy the used part
+	class HistoryStack
+	{
+	public:
+		static constexpr size_t MAX_GAME_PLY = 2048;
+		static constexpr size_t MAX_SEARCH_PLY = 128;
+		static constexpr size_t CAPACITY = MAX_GAME_PLY + MAX_SEARCH_PLY;
+
+		HistoryStack() = default;
+
+		HistoryStack(const HistoryStack& other) : count(other.count)
+		{
+			std::copy(other.entries.begin(), other.entries.begin() + count, entries.begin());
+		}
+
+		HistoryStack& operator=(const HistoryStack& other)
+		{
+			count = other.count;
+			std::copy(other.entries.begin(), other.entries.begin() + count, entries.begin());
+			return *this;
+		}
+
+		__forceinline void push_back(const History& history)
+		{
+			// Only reachable in absurdly long games, the oldest moves can't be unmade by the search anyway
+			if (count == CAPACITY)
+			{
+				std::copy(entries.begin() + 1, entries.end(), entries.begin());
+				--count;
+			}
+
+			entries[count++] = history;
+		}
+
+		__forceinline void pop_back() { --count; }
+		__forceinline const History& back() const { return entries[count - 1]; }
+		__forceinline const History& operator[](size_t index) const { return entries[index]; }
+		__forceinline size_t size() const { return count; }
+		__forceinline bool empty() const { return count == 0; }
+		__forceinline void clear() { count = 0; }
+
+	private:
+		std::array<History, CAPACITY> entries;
+		size_t count = 0;
+	};
+
 
 	Bitboard whitePawns;
 	Bitboard blackPawns;
@@ -185,6 +238,7 @@ struct BoardState
 	Bitboard blackKing;
 
 	uint64_t zobristKey = 0;
+	uint64_t pawnKey = 0; // Zobrist hash of the pawns alone, keys the pawn structure cache
 
 	bool whiteTurn;
     uint8_t castlingRights; // 0b black queenside | black kingside | white queenside | white kingside
@@ -192,15 +246,57 @@ struct BoardState
     uint16_t halfmoveClock;
     uint16_t fullmoveNumber;
 
-	std::vector<History> historyStack;
+	HistoryStack historyStack;
+
+	std::array<uint8_t, 64> mailbox; // Piece on every square (Piece::NONE when empty), kept in sync with the bitboards
+
+	// Material plus piece-square sum from white's point of view and the game phase, kept up to date by makeMove so
+	// the evaluation doesn't have to add up every piece. See Evaluation::pieceSquareTable
+	Score score{};
+	uint8_t phase = 0;
 
 	void makeMove(const Move& move);
 	void unmakeMove();
 
+	void makeNullMove();
+	void unmakeNullMove();
+
+	// Recomputes score and phase from scratch
+	void computeScores();
+
+	void addPieceScore(uint8_t piece, Square sq);
+	void removePieceScore(uint8_t piece, Square sq);
+
+	// Adds or removes the pawns a move touches from pawnKey. Applying it twice cancels out, so unmakeMove calls it as well
+	void togglePawnKey(const Move& move, uint8_t capturedPiece, Square capturedSquare);
+
+	// The square behind the pawn that just double pushed, the opponent of the side to move made that push
+	__forceinline Bitboard enPassantFromFile(uint8_t file) const
+	{
+		return file == NO_EN_PASSANT ? 0 : 1ULL << ((whiteTurn ? 16 : 40) + file);
+	}
+
+	// Where the rook starts and lands for a castling move, decided by the king's destination
+	static __forceinline void castlingRookSquares(const Move& move, Square& rookFrom, Square& rookTo)
+	{
+		switch (move.endSquare)
+		{
+		case 62: rookFrom = 63; rookTo = 61; break; // White kingside
+		case 58: rookFrom = 56; rookTo = 59; break; // White queenside
+		case 6:  rookFrom = 7;  rookTo = 5;  break; // Black kingside
+		default: rookFrom = 0;  rookTo = 3;  break; // Black queenside
+		}
+	}
+
 	void parseFEN(const std::string& str);
 	std::string exportToFEN() const;
 
 
+	__forceinline uint8_t pieceOn(Square sq) const
+	{
+		return mailbox[sq];
+	}
+
 	__forceinline Bitboard all() const
 	{
 		return whitePawns | blackPawns | whiteKnights | blackKnights | whiteBishops | blackBishops | whiteRooks | blackRooks | (whiteQueens | blackQueens) | whiteKing | blackKing;
@@ -259,6 +355,17 @@ __forceinline static uint64_t computeZobristHash(const BoardState& board)
 	return key;
 }
 
+// Uses the same randoms as the pawns in computeZobristHash
+__forceinline static uint64_t computePawnHash(const BoardState& board)
+{
+	uint64_t key = 0;
+	Bitboard bb = board.blackPawns;
+	Bitloop(bb) key ^= Random64[SquareOf(bb)];
+	bb = board.whitePawns;
+	Bitloop(bb) key ^= Random64[64 + SquareOf(bb)];
+	return key;
+}
+
 __forceinline static uint64_t computePolyglotHash(const BoardState& board)
 {
     uint64_t key = 0;
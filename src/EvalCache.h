@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+
+// Static evaluations by zobrist key, one table per search thread so it needs no locking. Quiescence keeps coming
+// back to the same positions across iterations, a hit skips the whole evaluation.
+// Each entry is one 64 bit word: the upper 48 bits of the key to verify the hit, the evaluation in the lower 16 bits.
+// The index comes from the low key bits, which the verification doesn't use
+class EvalCache
+{
+public:
+	static constexpr size_t ENTRY_COUNT = 1 << 15; // 256KB
+	static constexpr uint64_t KEY_MASK = ~0xFFFFULL;
+
+	EvalCache() : entries(ENTRY_COUNT) {}
+
+	// Returns false on a miss, evaluations are from white's point of view
+	__forceinline bool probe(uint64_t key, int& eval) const
+	{
+		uint64_t entry = entries[key & (ENTRY_COUNT - 1)];
+		if ((entry ^ key) & KEY_MASK) return false;
+
+		eval = static_cast<int16_t>(static_cast<uint16_t>(entry));
+		return true;
+	}
+
+	__forceinline void store(uint64_t key, int eval)
+	{
+		eval = std::clamp(eval, static_cast<int>(INT16_MIN), static_cast<int>(INT16_MAX));
+		entries[key & (ENTRY_COUNT - 1)] = (key & KEY_MASK) | static_cast<uint16_t>(eval);
+	}
+
+private:
+	std::vector<uint64_t> entries;
+};
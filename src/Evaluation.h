@@ -13,11 +13,12 @@
 
 #include "Board.h"
 #include "MoveGenerator.h"
+#include "PawnTable.h"
 
 
 namespace Evaluation
 {
-	static constexpr std::array<uint16_t, 64> pawnBonus = {
+	static constexpr std::array<int16_t, 64> pawnBonusMiddle = {
 		 0,  0,  0,  0,  0,  0,  0,  0,
 		50, 50, 50, 50, 50, 50, 50, 50,
 		10, 10, 20, 30, 30, 20, 10, 10,
@@ -27,7 +28,7 @@ namespace Evaluation
 		 5, 10, 10,-20,-20, 10, 10,  5,
 		 0,  0,  0,  0,  0,  0,  0,  0
 	};
-	static constexpr std::array<uint16_t, 64> knightBonus = {
+	static constexpr std::array<int16_t, 64> knightBonusMiddle = {
 		-50,-40,-30,-30,-30,-30,-40,-50,
 		-40,-20,  0,  0,  0,  0,-20,-40,
 		-30,  0, 10, 15, 15, 10,  0,-30,
@@ -37,7 +38,7 @@ namespace Evaluation
 		-40,-20,  0,  5,  5,  0,-20,-40,
 		-50,-40,-30,-30,-30,-30,-40,-50	
 	};
-	static constexpr std::array<uint16_t, 64> bishopBonus = {
+	static constexpr std::array<int16_t, 64> bishopBonusMiddle = {
 		-20,-10,-10,-10,-10,-10,-10,-20,
 		-10,  0,  0,  0,  0,  0,  0,-10,
 		-10,  0,  5, 10, 10,  5,  0,-10,
@@ -47,7 +48,7 @@ namespace Evaluation
 		-10,  5,  0,  0,  0,  0,  5,-10,
 		-20,-10,-10,-10,-10,-10,-10,-20	
 	};
-	static constexpr std::array<uint16_t, 64> rookBonus = {
+	static constexpr std::array<int16_t, 64> rookBonusMiddle = {
 		0,  0,  0,  0,  0,  0,  0,  0,
 		5, 10, 10, 10, 10, 10, 10,  5,
 		-5,  0,  0,  0,  0,  0,  0, -5,
@@ -57,7 +58,7 @@ namespace Evaluation
 		-5,  0,  0,  0,  0,  0,  0, -5,
 		0,  0,  0,  5,  5,  0,  0,  0 
 	};
-	static constexpr std::array<uint16_t, 64> queenBonus = {
+	static constexpr std::array<int16_t, 64> queenBonusMiddle = {
 		-20,-10,-10, -5, -5,-10,-10,-20,
 		-10,  0,  0,  0,  0,  0,  0,-10,
 		-10,  0,  5,  5,  5,  5,  0,-10,
@@ -67,7 +68,7 @@ namespace Evaluation
 		-10,  0,  5,  0,  0,  0,  0,-10,
 		-20,-10,-10, -5, -5,-10,-10,-20		 
 	};
-	static constexpr std::array<uint16_t, 64> kingBonusMiddle = {
+	static constexpr std::array<int16_t, 64> kingBonusMiddle = {
 		-30,-40,-40,-50,-50,-40,-40,-30,
 		-30,-40,-40,-50,-50,-40,-40,-30,
 		-30,-40,-40,-50,-50,-40,-40,-30,
@@ -77,7 +78,7 @@ namespace Evaluation
 		 20, 20,  0,  0,  0,  0, 20, 20,
 		 20, 30, 10,  0,  0, 10, 30, 20
 	};
-	static constexpr std::array<uint16_t, 64> kingBonusEnd = {
+	static constexpr std::array<int16_t, 64> kingBonusEnd = {
 		-50,-40,-30,-20,-20,-30,-40,-50,
 		-30,-20,-10,  0,  0,-10,-20,-30,
 		-30,-10, 20, 30, 30, 20,-10,-30,
@@ -88,11 +89,101 @@ namespace Evaluation
 		-50,-30,-30,-30,-30,-30,-30,-50		
 	};
 
+	// Endgame tables: pawns are worth more the closer they are to promoting, the other pieces want the centre
+	static constexpr std::array<int16_t, 64> pawnBonusEnd = {
+		 0,  0,  0,  0,  0,  0,  0,  0,
+		80, 80, 80, 80, 80, 80, 80, 80,
+		50, 50, 50, 50, 50, 50, 50, 50,
+		30, 30, 30, 30, 30, 30, 30, 30,
+		15, 15, 15, 15, 15, 15, 15, 15,
+		 5,  5,  5,  5,  5,  5,  5,  5,
+		 0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0
+	};
+	static constexpr std::array<int16_t, 64> knightBonusEnd = {
+		-50,-40,-30,-30,-30,-30,-40,-50,
+		-40,-20,-10, -5, -5,-10,-20,-40,
+		-30,-10, 10, 15, 15, 10,-10,-30,
+		-30, -5, 15, 20, 20, 15, -5,-30,
+		-30, -5, 15, 20, 20, 15, -5,-30,
+		-30,-10, 10, 15, 15, 10,-10,-30,
+		-40,-20,-10, -5, -5,-10,-20,-40,
+		-50,-40,-30,-30,-30,-30,-40,-50
+	};
+	static constexpr std::array<int16_t, 64> bishopBonusEnd = {
+		-15,-10,-10,-10,-10,-10,-10,-15,
+		-10,  0,  0,  0,  0,  0,  0,-10,
+		-10,  0,  5,  5,  5,  5,  0,-10,
+		-10,  0,  5, 10, 10,  5,  0,-10,
+		-10,  0,  5, 10, 10,  5,  0,-10,
+		-10,  0,  5,  5,  5,  5,  0,-10,
+		-10,  0,  0,  0,  0,  0,  0,-10,
+		-15,-10,-10,-10,-10,-10,-10,-15
+	};
+	static constexpr std::array<int16_t, 64> rookBonusEnd = {
+		 5,  5,  5,  5,  5,  5,  5,  5,
+		10, 10, 10, 10, 10, 10, 10, 10,
+		 0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0
+	};
+	static constexpr std::array<int16_t, 64> queenBonusEnd = {
+		-20,-10,-10, -5, -5,-10,-10,-20,
+		-10,  0,  5,  5,  5,  5,  0,-10,
+		-10,  5, 10, 10, 10, 10,  5,-10,
+		 -5,  5, 10, 15, 15, 10,  5, -5,
+		 -5,  5, 10, 15, 15, 10,  5, -5,
+		-10,  5, 10, 10, 10, 10,  5,-10,
+		-10,  0,  5,  5,  5,  5,  0,-10,
+		-20,-10,-10, -5, -5,-10,-10,-20
+	};
 
+	// Material by piece type, rooks and pawns gain in the endgame while the minor pieces lose a little.
+	// The king has no material value here, see getPieceValue for the values used by move ordering and SEE
+	static constexpr std::array<Score, 6> pieceScore = {
+		Score(100, 120), Score(320, 300), Score(330, 320), Score(500, 530), Score(905, 950), Score(0, 0)
+	};
+
+	// Game phase weight of every piece, Score::TOTAL_PHASE with all minor and major pieces still on the board
+	static constexpr std::array<uint8_t, 12> phaseWeight = {
+		0, 0,   // Pawns
+		1, 1,   // Knights
+		1, 1,   // Bishops
+		2, 2,   // Rooks
+		4, 4,   // Queens
+		0, 0    // Kings
+	};
 
-	__forceinline static int sumBonuses(Bitboard bb, const std::array<uint16_t, 64>& table)
+	// Material plus piece-square bonus of every piece on every square, from white's point of view (black pieces count
+	// negative and read their table mirrored). BoardState keeps the sum of these up to date move by move
+	static constexpr std::array<std::array<Score, 64>, 12> pieceSquareTable = []
 	{
-		const uint16_t* ptr = table.data();
+		const std::array<const std::array<int16_t, 64>*, 6> mgTables = { &pawnBonusMiddle, &knightBonusMiddle, &bishopBonusMiddle, &rookBonusMiddle, &queenBonusMiddle, &kingBonusMiddle };
+		const std::array<const std::array<int16_t, 64>*, 6> egTables = { &pawnBonusEnd, &knightBonusEnd, &bishopBonusEnd, &rookBonusEnd, &queenBonusEnd, &kingBonusEnd };
+
+		std::array<std::array<Score, 64>, 12> table{};
+		for (uint8_t type = 0; type < 6; ++type)
+		{
+			for (int sq = 0; sq < 64; ++sq)
+			{
+				Score score = pieceScore[type] + Score((*mgTables[type])[sq], (*egTables[type])[sq]);
+
+				table[Piece::make(0, type)][sq] = score;
+				table[Piece::make(1, type)][sq ^ 56] = -score;
+			}
+		}
+
+		return table;
+	}();
+
+	// Sums one bonus table over the squares of a bitboard, eight 16 bit lanes per step. Only the reference for
+	// sumPieceSquares now, the benchmark in Test.h compares the two
+	__forceinline static int sumBonuses(Bitboard bb, const std::array<int16_t, 64>& table)
+	{
+		const int16_t* ptr = table.data();
 		__m128i sum = _mm_setzero_si128();
 		const __m128i bit_mask = _mm_set_epi16(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
 
@@ -112,8 +203,44 @@ namespace Evaluation
 
 		// Horizontal sum
 		sum = _mm_add_epi32(_mm_cvtepi16_epi32(sum), _mm_cvtepi16_epi32(_mm_srli_si128(sum, 8)));
+		sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 8));
 		sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 4));
-		return _mm_extract_epi32(sum, 0) + _mm_extract_epi32(sum, 1);
+		return _mm_cvtsi128_si32(sum);
+	}
+
+	// Material plus piece-square Score of every piece on the board in one pass, used when the board's incremental sum
+	// has to be built from scratch. Each row of pieceSquareTable is 64 packed Scores: pdep spreads the bits of one byte
+	// of the bitboard into one byte per square, which widens into a mask over eight 32 bit lanes. Adding the masked
+	// Scores as plain 32 bit integers adds both packed halves at once
+	__forceinline static Score sumPieceSquares(const BoardState& board)
+	{
+		// Indexed by piece encoding, white pieces on the even indices
+		const std::array<Bitboard, 12> pieces = {
+			board.whitePawns, board.blackPawns, board.whiteKnights, board.blackKnights, board.whiteBishops, board.blackBishops,
+			board.whiteRooks, board.blackRooks, board.whiteQueens, board.blackQueens, board.whiteKing, board.blackKing
+		};
+
+		__m256i sum = _mm256_setzero_si256();
+
+		for (size_t piece = 0; piece < pieces.size(); ++piece)
+		{
+			Bitboard bb = pieces[piece];
+			const Score* row = pieceSquareTable[piece].data();
+
+			for (int i = 0; bb; i += 8, bb >>= 8)
+			{
+				uint64_t byteMask = _pdep_u64(bb & 0xFF, 0x0101010101010101ULL) * 0xFF;
+				__m256i mask = _mm256_cvtepi8_epi32(_mm_cvtsi64_si128(static_cast<int64_t>(byteMask)));
+				__m256i scores = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+				sum = _mm256_add_epi32(sum, _mm256_and_si256(scores, mask));
+			}
+		}
+
+		// Horizontal sum of the eight lanes
+		__m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+		half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+		return Score::fromPacked(static_cast<uint32_t>(_mm_cvtsi128_si32(half)));
 	}
 
 	__forceinline static constexpr int getPieceValue(uint8_t piece)
@@ -134,78 +261,152 @@ namespace Evaluation
 		if (move.enpassantFlag) {
 			return board.whiteTurn ? Piece::BP : Piece::WP; // En passant captures a pawn
 		}
-		Square endSq = move.endSquare;
-		Bitboard endBB = 1ULL << endSq;
-		if (board.whitePawns & endBB) return Piece::WP;
-		else if (board.whiteKnights & endBB) return Piece::WN;
-		else if (board.whiteBishops & endBB) return Piece::WB;
-		else if (board.whiteRooks & endBB) return Piece::WR;
-		else if (board.whiteQueens & endBB) return Piece::WQ;
-		else if (board.whiteKing & endBB) return Piece::WK;
-		else if (board.blackPawns & endBB) return Piece::BP;
-		else if (board.blackKnights & endBB) return Piece::BN;
-		else if (board.blackBishops & endBB) return Piece::BB;
-		else if (board.blackRooks & endBB) return Piece::BR;
-		else if (board.blackQueens & endBB) return Piece::BQ;
-		else if (board.blackKing & endBB) return Piece::BK;
-		else return Piece::NONE;
+		return board.pieceOn(move.endSquare);
+	}
+
+	// Every piece of either colour attacking the square, sliders are blocked by the given occupancy
+	__forceinline static Bitboard attackersTo(const BoardState& board, Square sq, Bitboard occupied)
+	{
+		constexpr Bitboard notEdgeLeft = ~0x0101010101010101ULL;
+		constexpr Bitboard notEdgeRight = ~0x8080808080808080ULL;
+		Bitboard sqBB = 1ULL << sq;
+
+		// A pawn attacks the square if an enemy pawn standing on it could capture the pawn
+		Bitboard whitePawns = (shift<Bitboard, Helpers::getPawnCaptureDirLeft<false>()>(sqBB & notEdgeLeft) |
+							   shift<Bitboard, Helpers::getPawnCaptureDirRight<false>()>(sqBB & notEdgeRight)) & board.whitePawns;
+		Bitboard blackPawns = (shift<Bitboard, Helpers::getPawnCaptureDirLeft<true>()>(sqBB & notEdgeLeft) |
+							   shift<Bitboard, Helpers::getPawnCaptureDirRight<true>()>(sqBB & notEdgeRight)) & board.blackPawns;
+
+		Bitboard diagonal = board.whiteBishops | board.blackBishops | board.whiteQueens | board.blackQueens;
+		Bitboard straight = board.whiteRooks | board.blackRooks | board.whiteQueens | board.blackQueens;
+
+		return whitePawns | blackPawns
+			 | (Lookup::lookupKnightMove(sq) & (board.whiteKnights | board.blackKnights))
+			 | (Lookup::lookupKingMove(sq) & (board.whiteKing | board.blackKing))
+			 | (Lookup::lookupBishopMove(occupied, sq) & diagonal)
+			 | (Lookup::lookupRookMove(occupied, sq) & straight);
 	}
 
+	// Static exchange evaluation. Plays out every capture on the move's target square, always recapturing with the least
+	// valuable piece, and returns true if the side to move ends up at least `threshold` ahead. Pins are ignored
+	__forceinline static bool see(const BoardState& board, const Move& move, int threshold)
+	{
+		if (move.castlingFlag) return threshold <= 0;
+
+		Square from = move.startSquare;
+		Square to = move.endSquare;
+
+		int gain = getPieceValue(getCapturedPieceType(board, move));
+		uint8_t nextVictim = move.piece;
+		if (move.promotedPiece != Piece::NONE)
+		{
+			gain += getPieceValue(move.promotedPiece) - getPieceValue(Piece::WP);
+			nextVictim = move.promotedPiece;
+		}
+
+		// Even keeping the whole capture isn't enough
+		int swap = gain - threshold;
+		if (swap < 0) return false;
+
+		// Still ahead after losing the moved piece for nothing
+		swap = getPieceValue(nextVictim) - swap;
+		if (swap <= 0) return true;
+
+		Bitboard occupied = board.all() ^ (1ULL << from);
+		if (move.enpassantFlag) occupied ^= 1ULL << (board.whiteTurn ? to + 8 : to - 8);
+
+		Bitboard diagonal = board.whiteBishops | board.blackBishops | board.whiteQueens | board.blackQueens;
+		Bitboard straight = board.whiteRooks | board.blackRooks | board.whiteQueens | board.blackQueens;
+		Bitboard attackers = attackersTo(board, to, occupied) & occupied;
+
+		bool stm = board.whiteTurn;
+		bool result = true;
+
+		while (true)
+		{
+			stm = !stm;
+			attackers &= occupied;
+
+			Bitboard stmAttackers = attackers & (stm ? board.white() : board.black());
+			if (!stmAttackers) break;
+
+			result = !result;
+
+			// Taking with the least valuable attacker, the x-ray lookups add the sliders that were standing behind it
+			Bitboard bb;
+			if ((bb = stmAttackers & (board.whitePawns | board.blackPawns)))
+			{
+				if ((swap = getPieceValue(Piece::WP) - swap) < result) break;
+				bb &= 0 - bb;
+				attackers |= Lookup::bishopXray(occupied, bb, to) & diagonal;
+			}
+			else if ((bb = stmAttackers & (board.whiteKnights | board.blackKnights)))
+			{
+				if ((swap = getPieceValue(Piece::WN) - swap) < result) break;
+				bb &= 0 - bb;
+			}
+			else if ((bb = stmAttackers & (board.whiteBishops | board.blackBishops)))
+			{
+				if ((swap = getPieceValue(Piece::WB) - swap) < result) break;
+				bb &= 0 - bb;
+				attackers |= Lookup::bishopXray(occupied, bb, to) & diagonal;
+			}
+			else if ((bb = stmAttackers & (board.whiteRooks | board.blackRooks)))
+			{
+				if ((swap = getPieceValue(Piece::WR) - swap) < result) break;
+				bb &= 0 - bb;
+				attackers |= Lookup::rookXray(occupied, bb, to) & straight;
+			}
+			else if ((bb = stmAttackers & (board.whiteQueens | board.blackQueens)))
+			{
+				if ((swap = getPieceValue(Piece::WQ) - swap) < result) break;
+				bb &= 0 - bb;
+				attackers |= (Lookup::bishopXray(occupied, bb, to) & diagonal) | (Lookup::rookXray(occupied, bb, to) & straight);
+			}
+			else
+			{
+				// The king can only take last, if the other side still has an attacker the capture is illegal
+				return (attackers & ~(stm ? board.white() : board.black())) ? !result : result;
+			}
+
+			occupied ^= bb;
+		}
+
+		return result;
+	}
+
+	constexpr Score KNIGHT_OUTPOST = Score(20, 15);
+	constexpr Score BISHOP_OUTPOST = Score(10, 5);
+	constexpr Score FREE_PASSER = Score(5, 20);
+
+	// Pawn structure terms that also depend on the pieces, so they can't live in the pawn table. An outpost is a
+	// square on the 4th to 6th rank that a friendly pawn defends and no enemy pawn can ever attack. A passed pawn
+	// with nothing at all in front of it is harder to stop
+	template<bool White>
+	__forceinline static Score pieceStructureTerms(const BoardState& board, const PawnEntry& pawns)
+	{
+		constexpr int us = White ? 0 : 1;
+		constexpr Bitboard outpostRanks = White ? 0x000000FFFFFF0000ULL : 0x0000FFFFFF000000ULL;
+
+		Bitboard ownPawns = White ? board.whitePawns : board.blackPawns;
+		Bitboard outposts = outpostRanks & PawnStructure::attacks<White>(ownPawns) & ~pawns.attackSpans[1 - us];
+
+		Bitboard blocked = PawnStructure::fillForward<!White>(PawnStructure::forward<!White>(board.all()));
+
+		return KNIGHT_OUTPOST * static_cast<int>(__popcnt64(outposts & (White ? board.whiteKnights : board.blackKnights)))
+			 + BISHOP_OUTPOST * static_cast<int>(__popcnt64(outposts & (White ? board.whiteBishops : board.blackBishops)))
+			 + FREE_PASSER * static_cast<int>(__popcnt64(pawns.passedPawns[us] & ~blocked));
+	}
+
+	// Material and piece-square scores are summed incrementally by the board, pawn structure comes from the search
+	// thread's pawn table. The total is tapered between the middlegame and endgame halves by the phase
 	template<bool Turn>
-	__forceinline static int evaluate(const BoardState& board)
+	__forceinline static int evaluate(const BoardState& board, PawnTable& pawnTable)
 	{
-		// Material calculation
-		int whiteMaterial = __popcnt64(board.whitePawns) * getPieceValue(Piece::WP) +
-			__popcnt64(board.whiteKnights) * getPieceValue(Piece::WN) +
-			__popcnt64(board.whiteBishops) * getPieceValue(Piece::WB) +
-			__popcnt64(board.whiteRooks) * getPieceValue(Piece::WR) +
-			__popcnt64(board.whiteQueens) * getPieceValue(Piece::WQ);
-
-		int blackMaterial = __popcnt64(board.blackPawns) * getPieceValue(Piece::WP) +
-			__popcnt64(board.blackKnights) * getPieceValue(Piece::WN) +
-			__popcnt64(board.blackBishops) * getPieceValue(Piece::WB) +
-			__popcnt64(board.blackRooks) * getPieceValue(Piece::WR) +
-			__popcnt64(board.blackQueens) * getPieceValue(Piece::WQ);
-
-		int phase = (__popcnt64(board.whiteQueens + board.blackQueens) * 4) +
-			(__popcnt64(board.whiteRooks + board.blackRooks) * 2) +
-			(__popcnt64(board.whiteBishops + board.blackBishops +
-				board.whiteKnights + board.blackKnights) * 1);
-		const int totalPhase = 24;
-		double phaseFactor = std::clamp(phase / (double)totalPhase, 0.0, 1.0);
-
-		int whitePositional = 0, blackPositional = 0;
-
-		whitePositional += sumBonuses(board.whitePawns, Evaluation::pawnBonus);
-		blackPositional += sumBonuses(mirrorVertical(board.blackPawns), Evaluation::pawnBonus);
-
-		whitePositional += sumBonuses(board.whiteKnights, Evaluation::knightBonus);
-		blackPositional += sumBonuses(mirrorVertical(board.blackKnights), Evaluation::knightBonus);
-
-		whitePositional += sumBonuses(board.whiteBishops, Evaluation::bishopBonus);
-		blackPositional += sumBonuses(mirrorVertical(board.blackBishops), Evaluation::bishopBonus);
-
-		whitePositional += sumBonuses(board.whiteRooks, Evaluation::rookBonus);
-		blackPositional += sumBonuses(mirrorVertical(board.blackRooks), Evaluation::rookBonus);
-
-		whitePositional += sumBonuses(board.whiteQueens, Evaluation::queenBonus);
-		blackPositional += sumBonuses(mirrorVertical(board.blackQueens), Evaluation::queenBonus);
-
-		// Tapered king safety
-		int whiteKingMiddle = sumBonuses(board.whiteKing, Evaluation::kingBonusMiddle);
-		int whiteKingEnd = sumBonuses(board.whiteKing, Evaluation::kingBonusEnd);
-		int whiteKingScore = static_cast<int>(whiteKingMiddle * phaseFactor + whiteKingEnd * (1 - phaseFactor));
-		whitePositional += whiteKingScore;
-
-		Bitboard blackKingMirrored = mirrorVertical(board.blackKing);
-		int blackKingMiddle = sumBonuses(blackKingMirrored, Evaluation::kingBonusMiddle);
-		int blackKingEnd = sumBonuses(blackKingMirrored, Evaluation::kingBonusEnd);
-		int blackKingScore = static_cast<int>(blackKingMiddle * phaseFactor + blackKingEnd * (1 - phaseFactor));
-		blackPositional += blackKingScore;
-
-		int materialDifference = whiteMaterial - blackMaterial;
-		int positionalDifference = whitePositional - blackPositional;
-		int totalScore = materialDifference + positionalDifference;
+		const PawnEntry& pawns = pawnTable.probe(board);
+
+		Score total = board.score + pawns.score + pieceStructureTerms<true>(board, pawns) - pieceStructureTerms<false>(board, pawns);
+		int totalScore = total.taper(board.phase);
 
 		if constexpr (Turn)
 		{
@@ -171,6 +171,13 @@ namespace Helpers
         else return board.white();
     }
 
+	// Knights, bishops, rooks and queens, used to guard against zugzwang in pawn endings
+	template <bool Turn>
+	_Compiletime Bitboard getNonPawnMaterial(BoardState& board) 
+	{
+		return getKnights<Turn>(board) | getBishops<Turn>(board) | getRooks<Turn>(board) | getQueens<Turn>(board);
+	}
+
     static __forceinline Bitboard getOccupied(const BoardState& board) 
     {
         return board.all();
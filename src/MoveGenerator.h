@@ -18,6 +18,14 @@ _Compiletime T shift(T num) {
 
 typedef std::array<Move, 218> MoveArr;
 
+// Which moves generateLegalMoves produces. Captures only gives captures and queen promotions (for quiescence),
+// unless the side to move is in check, then every evasion is generated
+enum class GenType : uint8_t
+{
+	All,
+	Captures
+};
+
 
 
 class MoveGenerator
@@ -44,7 +52,7 @@ public:
 		else whiteAttacked = calculateAttackedSquares<true>(board);
 	}
 
-	template<bool Turn>
+	template<bool Turn, GenType Type = GenType::All>
 	__forceinline int generateLegalMoves(MoveArr& moves, BoardState& board)
 	{
 		initStack<Turn>(board);
@@ -74,17 +82,17 @@ public:
 		int moveCount = 0;
 
 		if (checkCount >= 2) {
-			moveCount = generateKingMoves<Turn>(moves, moveCount, board, occupied, friendly, enemy);
+			moveCount = generateKingMoves<Turn, GenType::All>(moves, moveCount, board, occupied, friendly, enemy);
 			inCheck = true;
 			return moveCount;
 		}
 
-		moveCount = generatePawnMoves<Turn>(moves, moveCount, board, occupied, friendly, enemy);
-		moveCount = generateKnightMoves<Turn>(moves, moveCount, board, occupied, friendly, enemy);
-		moveCount = generateBishopMoves<Turn>(moves, moveCount, board, occupied, friendly, enemy);
-		moveCount = generateRookMoves<Turn>(moves, moveCount, board, occupied, friendly, enemy);
-		moveCount = generateQueenMoves<Turn>(moves, moveCount, board, occupied, friendly, enemy);
-		moveCount = generateKingMoves<Turn>(moves, moveCount, board, occupied, friendly, enemy);
+		if constexpr (Type == GenType::Captures)
+		{
+			if (checkCount == 0) return generatePieceMoves<Turn, GenType::Captures>(moves, moveCount, board, occupied, friendly, enemy);
+		}
+
+		moveCount = generatePieceMoves<Turn, GenType::All>(moves, moveCount, board, occupied, friendly, enemy);
 
 		if (checkCount != 0)
 		{
@@ -97,6 +105,122 @@ public:
 		return moveCount;
 	}
 	
+	// Rebuilds a full move from the 16 bit transposition table form (see TTEntry::packMove) using the pieces on the board.
+	// Returns a null move if there is no friendly piece on the start square
+	template<bool Turn>
+	__forceinline Move decodeMove(BoardState& board, uint16_t packed) const
+	{
+		uint8_t from = packed & 0x3F;
+		uint8_t to = (packed >> 6) & 0x3F;
+		uint8_t promotionType = (packed >> 12) & 0x7;
+		Bitboard toBB = 1ULL << to;
+
+		uint8_t piece = board.pieceOn(from);
+		if (piece == Piece::NONE || Piece::getColor(piece) != (Turn ? 0 : 1)) return Move{};
+
+		bool isPawn = Piece::getType(piece) == 0;
+		bool isKing = Piece::getType(piece) == 5;
+		int distance = from > to ? from - to : to - from;
+
+		Move move{};
+		move.startSquare = from;
+		move.endSquare = to;
+		move.piece = piece;
+		move.promotedPiece = promotionType ? Piece::make(Turn ? 0 : 1, promotionType) : Piece::NONE;
+		move.enpassantFlag = isPawn && board.enPassant == toBB;
+		move.captureFlag = board.pieceOn(to) != Piece::NONE || move.enpassantFlag;
+		move.doublePushFlag = isPawn && distance == 16;
+		move.castlingFlag = isKing && distance == 2;
+		return move;
+	}
+
+	// Checks a move that did not come from this generator (the transposition table move) without generating the whole list.
+	// The move has to come from decodeMove, castling and en passant are rare enough that they are simply rejected
+	template<bool Turn>
+	__forceinline bool isLegal(BoardState& board, const Move& move) const
+	{
+		if (move.isNull() || move.castlingFlag || move.enpassantFlag) return false;
+
+		Square from = move.startSquare;
+		Square to = move.endSquare;
+		Bitboard fromBB = 1ULL << from;
+		Bitboard toBB = 1ULL << to;
+		Bitboard occupied = board.all();
+		Bitboard friendly = Helpers::getFriendly<Turn>(board);
+		Bitboard enemy = Helpers::getEnemy<Turn>(board);
+
+		if ((toBB & friendly) || (toBB & Helpers::getEnemyKing<Turn>(board))) return false;
+
+		Bitboard reachable;
+		switch (Piece::getType(move.piece))
+		{
+		case 0:
+		{
+			constexpr int8_t pawnPushDir = Helpers::getPawnPushDir<Turn>();
+			constexpr Bitboard notEdgeRight = ~0x8080808080808080ULL;
+			constexpr Bitboard notEdgeLeft = ~0x0101010101010101ULL;
+
+			if (((toBB & Helpers::getPromotionMask<Turn>()) != 0) != (move.promotedPiece != Piece::NONE)) return false;
+
+			if (move.captureFlag)
+			{
+				reachable = (shift<Bitboard, Helpers::getPawnCaptureDirLeft<Turn>()>(fromBB & notEdgeLeft) |
+							 shift<Bitboard, Helpers::getPawnCaptureDirRight<Turn>()>(fromBB & notEdgeRight)) & enemy;
+			}
+			else if (move.doublePushFlag)
+			{
+				Bitboard between = shift<Bitboard, pawnPushDir>(fromBB & Helpers::getDoublePushMask<Turn>());
+				reachable = (between & occupied) ? 0 : shift<Bitboard, pawnPushDir>(between) & ~occupied;
+			}
+			else
+			{
+				reachable = shift<Bitboard, pawnPushDir>(fromBB) & ~occupied;
+			}
+			break;
+		}
+		case 1: reachable = Lookup::lookupKnightMove(from); break;
+		case 2: reachable = Lookup::lookupBishopMove(occupied, from); break;
+		case 3: reachable = Lookup::lookupRookMove(occupied, from); break;
+		case 4: reachable = Lookup::lookupQueenMove(occupied, from); break;
+		default: reachable = Lookup::lookupKingMove(from); break;
+		}
+
+		if (!(reachable & toBB)) return false;
+		if (Piece::getType(move.piece) != 0 && move.promotedPiece != Piece::NONE) return false;
+
+		// The move is possible, now make sure it doesn't leave our own king attacked
+		Bitboard occupiedAfter = (occupied ^ fromBB) | toBB;
+		Bitboard king = Helpers::getKing<Turn>(board);
+		Square kingSq = (king & fromBB) ? to : SquareOf(king);
+
+		return (enemyAttackersTo<Turn>(board, kingSq, occupiedAfter) & ~toBB) == 0;
+	}
+
+	// Cheaper than generating when only the check status is needed
+	template<bool Turn>
+	__forceinline bool isInCheck(BoardState& board) const
+	{
+		return enemyAttackersTo<Turn>(board, SquareOf(Helpers::getKing<Turn>(board)), board.all()) != 0;
+	}
+
+	// Every enemy piece attacking the square, sliders are blocked by the given occupancy
+	template<bool Turn>
+	__forceinline Bitboard enemyAttackersTo(BoardState& board, Square sq, Bitboard occupied) const
+	{
+		constexpr Bitboard notEdgeRight = ~0x8080808080808080ULL;
+		constexpr Bitboard notEdgeLeft = ~0x0101010101010101ULL;
+		Bitboard sqBB = 1ULL << sq;
+
+		Bitboard attackers = Lookup::lookupKnightMove(sq) & Helpers::getEnemyKnights<Turn>(board);
+		attackers |= Lookup::lookupBishopMove(occupied, sq) & Helpers::getEnemyD12<Turn>(board);
+		attackers |= Lookup::lookupRookMove(occupied, sq) & Helpers::getEnemyHV<Turn>(board);
+		attackers |= Lookup::lookupKingMove(sq) & Helpers::getEnemyKing<Turn>(board);
+		attackers |= (shift<Bitboard, Helpers::getPawnCaptureDirLeft<Turn>()>(sqBB & notEdgeLeft) |
+					  shift<Bitboard, Helpers::getPawnCaptureDirRight<Turn>()>(sqBB & notEdgeRight)) & Helpers::getEnemyPawns<Turn>(board);
+
+		return attackers;
+	}
+
 	template<bool Turn>
 	__forceinline Bitboard calculateAttackedSquares(BoardState& board)
 	{
@@ -151,6 +275,18 @@ public:
 
 
 private:
+	template<bool Turn, GenType Type>
+	__forceinline int generatePieceMoves(MoveArr& moves, int moveCount, BoardState& board, const Bitboard& occupied, const Bitboard& friendly, const Bitboard& enemy)
+	{
+		moveCount = generatePawnMoves<Turn, Type>(moves, moveCount, board, occupied, friendly, enemy);
+		moveCount = generateKnightMoves<Turn, Type>(moves, moveCount, board, occupied, friendly, enemy);
+		moveCount = generateBishopMoves<Turn, Type>(moves, moveCount, board, occupied, friendly, enemy);
+		moveCount = generateRookMoves<Turn, Type>(moves, moveCount, board, occupied, friendly, enemy);
+		moveCount = generateQueenMoves<Turn, Type>(moves, moveCount, board, occupied, friendly, enemy);
+		moveCount = generateKingMoves<Turn, Type>(moves, moveCount, board, occupied, friendly, enemy);
+		return moveCount;
+	}
+
 	template<bool Turn>
 	__forceinline void handleEP(MoveArr& moves, int& moveCount, BoardState& board, const Bitboard& occupied, const Bitboard& enemyHV)
 	{
@@ -307,7 +443,7 @@ private:
 		return checkMask;
 	}
 	
-	template<bool Turn>
+	template<bool Turn, GenType Type>
 	__forceinline int generatePawnMoves(MoveArr& moves, int moveCount, BoardState& board, const Bitboard& occupied, const Bitboard& friendly, const Bitboard& enemy)
 	{
 		Bitboard pawns = Helpers::getPawns<Turn>(board);
@@ -334,6 +470,7 @@ private:
 				Bitboard singlePush = (shift<Bitboard, pawnPushDir>(pinnedHv)) & cashedPinHV & cashedCheckMask & ~occupied;
 				Bitboard promotions = singlePush & promotionMask;
 				singlePush &= ~promotionMask;
+				if constexpr (Type == GenType::Captures) singlePush = 0;
 
 				Bitloop(singlePush)
 				{
@@ -343,11 +480,12 @@ private:
 				Bitloop(promotions)
 				{
 					int8_t sq = SquareOf(promotions);
-					addPromotions<Turn>(moves, moveCount, sq + pawnPushDir, sq, false);
+					addPromotions<Turn, Type>(moves, moveCount, sq + pawnPushDir, sq, false);
 				}
 			}
 			
 			Bitboard doublePush = shift<Bitboard, 2 * pawnPushDir>((pinnedHv & doublePushMask)) & cashedPinHV & cashedCheckMask & ~(occupied | shift<Bitboard, pawnPushDir>(occupied));
+			if constexpr (Type == GenType::Captures) doublePush = 0;
 			Bitloop(doublePush)
 			{
 				uint8_t sq = SquareOf(doublePush);
@@ -379,12 +517,12 @@ private:
 			Bitloop(promotionLeft)
 			{
 				int8_t sq = SquareOf(promotionLeft);
-				addPromotions<Turn>(moves, moveCount, sq + pawnCaptureDirLeft, static_cast<uint8_t>(sq), true);
+				addPromotions<Turn, Type>(moves, moveCount, sq + pawnCaptureDirLeft, static_cast<uint8_t>(sq), true);
 			}
 			Bitloop(promotionRight)
 			{
 				int8_t sq = SquareOf(promotionRight);
-				addPromotions<Turn>(moves, moveCount, sq + pawnCaptureDirRight, static_cast<uint8_t>(sq), true);
+				addPromotions<Turn, Type>(moves, moveCount, sq + pawnCaptureDirRight, static_cast<uint8_t>(sq), true);
 			}
 		}
 
@@ -397,13 +535,16 @@ private:
 			Bitboard attackLeft = shift<Bitboard, pawnCaptureDirLeft>((notPinned & notEdgeLeft)) & cashedCheckMask & enemy;
 			Bitboard attackRight = shift<Bitboard, pawnCaptureDirRight>((notPinned & notEdgeRight)) & cashedCheckMask & enemy;
 
+			if constexpr (Type == GenType::Captures) doublePush = 0;
+
 			promotions = singlePush & promotionMask;
 			Bitloop(promotions)
 			{
 				int8_t sq = SquareOf(promotions);
-				addPromotions<Turn>(moves, moveCount, sq + pawnPushDir, sq, false);
+				addPromotions<Turn, Type>(moves, moveCount, sq + pawnPushDir, sq, false);
 			}
 			singlePush &= ~promotionMask;
+			if constexpr (Type == GenType::Captures) singlePush = 0;
 			Bitloop(singlePush)
 			{
 				int8_t sq = SquareOf(singlePush);
@@ -420,13 +561,13 @@ private:
 			Bitloop(promotions)
 			{
 				int8_t sq = SquareOf(promotions);
-				addPromotions<Turn>(moves, moveCount, sq + pawnCaptureDirLeft, static_cast<uint8_t>(sq), true);
+				addPromotions<Turn, Type>(moves, moveCount, sq + pawnCaptureDirLeft, static_cast<uint8_t>(sq), true);
 			}
 			promotions = attackRight & promotionMask;
 			Bitloop(promotions)
 			{
 				int8_t sq = SquareOf(promotions);
-				addPromotions<Turn>(moves, moveCount, sq + pawnCaptureDirRight, static_cast<uint8_t>(sq), true);
+				addPromotions<Turn, Type>(moves, moveCount, sq + pawnCaptureDirRight, static_cast<uint8_t>(sq), true);
 			}
 
 			attackLeft &= ~promotionMask;
@@ -454,7 +595,7 @@ private:
 		return moveCount;
 	}
 	
-	template<bool Turn>
+	template<bool Turn, GenType Type>
 	__forceinline int generateKnightMoves(MoveArr& moves, int moveCount, BoardState& board, const Bitboard& occupied, const Bitboard& friendly, const Bitboard& enemy)
 	{
 		Bitboard knights = Helpers::getKnights<Turn>(board);
@@ -467,6 +608,7 @@ private:
 			Bitboard targets = Lookup::lookupKnightMove(sq) & ~friendly & cashedCheckMask;
 			Bitboard captures = targets & enemy;
 			targets &= ~enemy;
+			if constexpr (Type == GenType::Captures) targets = 0;
 
 			Bitloop(targets) 
 			{
@@ -481,7 +623,7 @@ private:
 	}
 
 
-	template<bool Turn>
+	template<bool Turn, GenType Type>
 	__forceinline int generateBishopMoves(MoveArr& moves, int moveCount, BoardState& board, const Bitboard& occupied, const Bitboard& friendly, const Bitboard& enemy)
 	{
 		Bitboard bishops = Helpers::getBishops<Turn>(board);
@@ -497,6 +639,7 @@ private:
 			Bitboard targets = Lookup::lookupBishopMove(occupied, sq) & ~friendly & cashedCheckMask & cashedPinD12;
 			Bitboard captures = targets & enemy;
 			targets &= ~enemy;
+			if constexpr (Type == GenType::Captures) targets = 0;
 
 			Bitloop(targets) 
 			{
@@ -514,6 +657,7 @@ private:
 			Bitboard targets = Lookup::lookupBishopMove(occupied, sq) & ~friendly & cashedCheckMask;
 			Bitboard captures = targets & enemy;
 			targets &= ~enemy;
+			if constexpr (Type == GenType::Captures) targets = 0;
 
 			Bitloop(targets) 
 			{
@@ -529,7 +673,7 @@ private:
 	}
 
 
-	template<bool Turn>
+	template<bool Turn, GenType Type>
 	__forceinline int generateRookMoves(MoveArr& moves, int moveCount, BoardState& board, const Bitboard& occupied, const Bitboard& friendly, const Bitboard& enemy)
 	{
 		Bitboard rooks = Helpers::getRooks<Turn>(board);
@@ -546,6 +690,7 @@ private:
 			Bitboard targets = Lookup::lookupRookMove(occupied, sq) & ~friendly & cashedCheckMask & cashedPinHV;
 			Bitboard captures = targets & enemy;
 			targets &= ~enemy;
+			if constexpr (Type == GenType::Captures) targets = 0;
 
 			Bitloop(targets) 
 			{
@@ -564,6 +709,7 @@ private:
 			Bitboard targets = Lookup::lookupRookMove(occupied, sq) & ~friendly & cashedCheckMask;
 			Bitboard captures = targets & enemy;
 			targets &= ~enemy;
+			if constexpr (Type == GenType::Captures) targets = 0;
 
 			Bitloop(targets) 
 			{
@@ -580,7 +726,7 @@ private:
 	}
 
 
-	template<bool Turn>
+	template<bool Turn, GenType Type>
 	__forceinline int generateQueenMoves(MoveArr& moves, int moveCount, BoardState& board, const Bitboard& occupied, const Bitboard& friendly, const Bitboard& enemy)
 	{
 		Bitboard queens = Helpers::getQueens<Turn>(board);
@@ -595,6 +741,7 @@ private:
 			Bitboard targets = Lookup::lookupQueenMove(occupied, sq) & ~friendly & cashedCheckMask & pinMask;
 			Bitboard captures = targets & enemy;
 			targets &= ~enemy;
+			if constexpr (Type == GenType::Captures) targets = 0;
 
 			Bitloop(targets) 
 			{
@@ -608,7 +755,7 @@ private:
 		return moveCount;
 	}
 
-	template<bool Turn>
+	template<bool Turn, GenType Type>
 	__forceinline int generateKingMoves(MoveArr& moves, int moveCount, BoardState& board, const Bitboard& occupied, const Bitboard& friendly, const Bitboard& enemy)
 	{
 		Square kingSq = SquareOf(Helpers::getKing<Turn>(board));
@@ -623,6 +770,7 @@ private:
 
 		Bitboard captures = kingMoves & enemy;
 		kingMoves &= ~enemy;
+		if constexpr (Type == GenType::Captures) kingMoves = 0;
 
 		Bitloop(kingMoves) {
 			moves[moveCount++] = { static_cast<uint8_t>(kingSq), static_cast<uint8_t>(SquareOf(kingMoves)), kingPiece, Piece::NONE, 0, 0, 0, 0 };
@@ -678,9 +826,10 @@ private:
 		}
 	}
 
-	template<bool Turn>
+	template<bool Turn, GenType Type>
 	void addPromotions(MoveArr& moves, int& moveCount, Square from, Square to, bool capture) {
 		moves[moveCount++] = { static_cast<uint8_t>(from), static_cast<uint8_t>(to), Turn ? Piece::WP : Piece::BP, Turn ? Piece::WQ : Piece::BQ, capture, 0, 0, 0 };
+		if constexpr (Type == GenType::Captures) return; // Under promotions are left to the full generator
 		moves[moveCount++] = { static_cast<uint8_t>(from), static_cast<uint8_t>(to), Turn ? Piece::WP : Piece::BP, Turn ? Piece::WR : Piece::BR, capture, 0, 0, 0 };
 		moves[moveCount++] = { static_cast<uint8_t>(from), static_cast<uint8_t>(to), Turn ? Piece::WP : Piece::BP, Turn ? Piece::WB : Piece::BB, capture, 0, 0, 0 };
 		moves[moveCount++] = { static_cast<uint8_t>(from), static_cast<uint8_t>(to), Turn ? Piece::WP : Piece::BP, Turn ? Piece::WN : Piece::BN, capture, 0, 0, 0 };
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <array>
+#include <utility>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#include "Board.h"
+#include "MoveGenerator.h"
+#include "Evaluation.h"
+#include "TranspositionTable.h"
+
+
+// Quiet move statistics gathered during the search, every search thread keeps its own copy.
+// The butterfly table scores a quiet move by colour, start and end square, the countermove table remembers which quiet
+// move refuted the opponent's last move (indexed by that move's piece and end square)
+struct QuietHistory
+{
+	static constexpr int MAX_HISTORY = 16384;
+	static constexpr int COUNTER_MOVE_BONUS = 2 * MAX_HISTORY + 1; // History stays within +-MAX_HISTORY, so the countermove always sorts first
+
+	int16_t butterfly[2][64][64];
+	Move counterMoves[12][64];
+
+	void clear()
+	{
+		std::memset(butterfly, 0, sizeof(butterfly));
+		for (auto& piece : counterMoves)
+		{
+			for (Move& move : piece) move = Move{};
+		}
+	}
+
+	template<bool Turn>
+	__forceinline int score(const Move& move) const
+	{
+		return butterfly[Turn ? 0 : 1][move.startSquare][move.endSquare];
+	}
+
+	// Gravity update, the closer an entry gets to MAX_HISTORY the less a bonus moves it, so no entry can saturate
+	template<bool Turn>
+	__forceinline void update(const Move& move, int bonus)
+	{
+		int16_t& entry = butterfly[Turn ? 0 : 1][move.startSquare][move.endSquare];
+		entry += bonus - entry * std::abs(bonus) / MAX_HISTORY;
+	}
+
+	__forceinline Move counterMove(const Move& previous) const
+	{
+		return previous.isNull() ? Move{} : counterMoves[previous.piece][previous.endSquare];
+	}
+
+	__forceinline void storeCounterMove(const Move& previous, const Move& move)
+	{
+		if (!previous.isNull()) counterMoves[previous.piece][previous.endSquare] = move;
+	}
+};
+
+// Hands out the moves of one node in stages, best guess first. The transposition table move is tried before anything
+// is generated, and after generation each call only selects the best remaining move instead of sorting the whole list.
+// Most cut nodes fail high on the first or second move, so most of the list is never ordered at all.
+// Captures that lose material by SEE are held back until after the quiet moves, quiescence drops them entirely.
+// Quiet moves after the killers are ordered by the thread's QuietHistory
+template<bool Turn>
+class MovePicker
+{
+public:
+	enum Stage : uint8_t
+	{
+		TT_MOVE,
+		GENERATE,
+		GOOD_CAPTURES,
+		KILLERS,
+		QUIETS,
+		BAD_CAPTURES,
+		DONE
+	};
+
+	MovePicker(MoveGenerator& moveGenerator, BoardState& board, MoveArr& moves, std::array<int, 218>& scores, uint16_t ttMove,
+			   const Move* killers, const QuietHistory& history, Move counterMove, bool capturesOnly)
+		: moveGenerator(moveGenerator), board(board), moves(moves), scores(scores), killers(killers), history(history), counterMove(counterMove),
+		  ttMove(ttMove), capturesOnly(capturesOnly)
+	{}
+
+	// Returns a null move once every move has been handed out
+	Move next()
+	{
+		switch (stage)
+		{
+		case TT_MOVE:
+			stage = GENERATE;
+			if (ttMove)
+			{
+				Move move = moveGenerator.decodeMove<Turn>(board, ttMove);
+				if ((!capturesOnly || isTactical(move)) && moveGenerator.isLegal<Turn>(board, move))
+				{
+					ttMoveReturned = true;
+					return move;
+				}
+			}
+			[[fallthrough]];
+
+		case GENERATE:
+			generate();
+			stage = GOOD_CAPTURES;
+			[[fallthrough]];
+
+		case GOOD_CAPTURES:
+			while (current < captureEnd)
+			{
+				Move move = selectBest(captureEnd);
+				if (Evaluation::see(board, move, 0)) return move;
+
+				// Losing captures are parked at the front of the list, everything before current has already been handed out
+				swap(current - 1, badCaptureEnd++);
+			}
+			stage = KILLERS;
+			[[fallthrough]];
+
+		case KILLERS:
+			while (killerIndex < 2)
+			{
+				const Move& killer = killers[killerIndex++];
+				for (int i = current; i < moveCount; ++i)
+				{
+					if (moves[i] == killer)
+					{
+						swap(i, current);
+						return moves[current++];
+					}
+				}
+			}
+			stage = QUIETS;
+			[[fallthrough]];
+
+		case QUIETS:
+			if (current < moveCount) return selectBest(moveCount);
+			stage = BAD_CAPTURES;
+			[[fallthrough]];
+
+		case BAD_CAPTURES:
+			// Quiescence doesn't search losing captures at all, unless they are needed to get out of check
+			if (capturesOnly && !generatedInCheck) badCaptureEnd = 0;
+			if (badCaptureIndex < badCaptureEnd) return moves[badCaptureIndex++];
+			stage = DONE;
+			[[fallthrough]];
+
+		case DONE:
+		default:
+			return Move{};
+		}
+	}
+
+	bool isTTMove(const Move& move) const
+	{
+		return ttMoveReturned && TTEntry::packMove(move) == ttMove;
+	}
+
+private:
+	static __forceinline bool isTactical(const Move& move)
+	{
+		return move.captureFlag || move.promotedPiece != Piece::NONE;
+	}
+
+	__forceinline int captureScore(const Move& move) const
+	{
+		int score = 0;
+
+		if (move.captureFlag)
+		{
+			uint8_t victim = Evaluation::getCapturedPieceType(board, move);
+			score += 10000 + (Evaluation::getPieceValue(victim) * 10) - Evaluation::getPieceValue(move.piece);
+		}
+
+		if (move.promotedPiece != Piece::NONE)
+		{
+			score += 5000 + Evaluation::getPieceValue(move.promotedPiece);
+		}
+
+		return score;
+	}
+
+	// Generates the legal moves, drops the already searched transposition table move and moves the tactical moves to the front.
+	// In captures only mode the generator only adds quiet moves when they are check evasions
+	void generate()
+	{
+		int generated = capturesOnly ? moveGenerator.generateLegalMoves<Turn, GenType::Captures>(moves, board)
+									 : moveGenerator.generateLegalMoves<Turn, GenType::All>(moves, board);
+		generatedInCheck = moveGenerator.inCheck;
+
+		moveCount = 0;
+		for (int i = 0; i < generated; ++i)
+		{
+			if (ttMoveReturned && TTEntry::packMove(moves[i]) == ttMove) continue;
+			moves[moveCount++] = moves[i];
+		}
+
+		captureEnd = 0;
+		for (int i = 0; i < moveCount; ++i)
+		{
+			if (!isTactical(moves[i])) continue;
+
+			swap(i, captureEnd);
+			scores[captureEnd] = captureScore(moves[captureEnd]);
+			++captureEnd;
+		}
+
+		// Quiet moves are ordered by history, the countermove goes first
+		for (int i = captureEnd; i < moveCount; ++i)
+		{
+			scores[i] = history.score<Turn>(moves[i]) + (moves[i] == counterMove ? QuietHistory::COUNTER_MOVE_BONUS : 0);
+		}
+	}
+
+	// Partial selection sort, one step per call
+	__forceinline Move selectBest(int end)
+	{
+		int best = current;
+		for (int i = current + 1; i < end; ++i)
+		{
+			if (scores[i] > scores[best]) best = i;
+		}
+
+		swap(best, current);
+		return moves[current++];
+	}
+
+	__forceinline void swap(int a, int b)
+	{
+		std::swap(moves[a], moves[b]);
+		std::swap(scores[a], scores[b]);
+	}
+
+	MoveGenerator& moveGenerator;
+	BoardState& board;
+	MoveArr& moves;
+	std::array<int, 218>& scores;
+	const Move* killers;
+	const QuietHistory& history;
+	Move counterMove;
+
+	uint16_t ttMove;
+	bool capturesOnly;
+	bool ttMoveReturned = false;
+	bool generatedInCheck = false;
+
+	Stage stage = TT_MOVE;
+	int current = 0;
+	int captureEnd = 0;
+	int badCaptureEnd = 0;
+	int badCaptureIndex = 0;
+	int moveCount = 0;
+	int killerIndex = 0;
+};
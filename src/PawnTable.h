@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+
+#include "Board.h"
+#include "Score.h"
+
+
+// Pawn structure terms. Everything here only depends on where the pawns stand, so the result can be cached under
+// BoardState::pawnKey. Sides are indexed white = 0, black = 1 and "forward" is towards the side's promotion rank
+namespace PawnStructure
+{
+	constexpr Bitboard FILE_A = 0x0101010101010101ULL;
+	constexpr Bitboard FILE_H = 0x8080808080808080ULL;
+
+	constexpr Score DOUBLED = Score(-10, -25);
+	constexpr Score ISOLATED = Score(-10, -15);
+	constexpr Score BACKWARD = Score(-8, -12);
+
+	// Indexed by rank counted from the side's own back rank
+	constexpr std::array<Score, 8> PASSED = {
+		Score(0, 0), Score(5, 10), Score(5, 15), Score(10, 25), Score(20, 45), Score(35, 75), Score(60, 120), Score(0, 0)
+	};
+
+	template<bool White>
+	__forceinline Bitboard forward(Bitboard bb)
+	{
+		if constexpr (White) return bb >> 8;
+		else return bb << 8;
+	}
+
+	// Smears every bit forward over the rest of its file
+	template<bool White>
+	__forceinline Bitboard fillForward(Bitboard bb)
+	{
+		if constexpr (White)
+		{
+			bb |= bb >> 8;
+			bb |= bb >> 16;
+			bb |= bb >> 32;
+		}
+		else
+		{
+			bb |= bb << 8;
+			bb |= bb << 16;
+			bb |= bb << 32;
+		}
+		return bb;
+	}
+
+	__forceinline Bitboard fillFiles(Bitboard bb)
+	{
+		return fillForward<true>(bb) | fillForward<false>(bb);
+	}
+
+	__forceinline Bitboard adjacentFiles(Bitboard bb)
+	{
+		return ((bb >> 1) & ~FILE_H) | ((bb << 1) & ~FILE_A);
+	}
+
+	template<bool White>
+	__forceinline Bitboard attacks(Bitboard pawns)
+	{
+		if constexpr (White) return ((pawns >> 9) & ~FILE_H) | ((pawns >> 7) & ~FILE_A);
+		else return ((pawns << 7) & ~FILE_H) | ((pawns << 9) & ~FILE_A);
+	}
+
+	// Every square the pawns attack now or could attack after advancing
+	template<bool White>
+	__forceinline Bitboard attackSpan(Bitboard pawns)
+	{
+		return fillForward<White>(attacks<White>(pawns));
+	}
+
+	// Doubled, isolated, backward and passed pawn terms for one side, the passed pawns are returned for the
+	// terms that also need the pieces
+	template<bool White>
+	__forceinline Score evaluateSide(Bitboard own, Bitboard enemy, Bitboard& passed)
+	{
+		Bitboard enemyFront = fillForward<!White>(forward<!White>(enemy));
+		Bitboard enemySpan = attackSpan<!White>(enemy);
+
+		// A pawn with a friendly pawn behind it on the same file, so a file with n pawns counts n - 1 times
+		Bitboard doubled = own & fillForward<White>(forward<White>(own));
+		Bitboard isolated = own & ~fillFiles(adjacentFiles(own));
+
+		// The square in front is attacked by an enemy pawn and no pawn on a neighbouring file is level or behind to support the advance
+		Bitboard backward = own & ~isolated & forward<!White>(attacks<!White>(enemy)) & ~fillForward<White>(adjacentFiles(own));
+
+		passed = own & ~(enemyFront | enemySpan);
+
+		Score score = DOUBLED * static_cast<int>(__popcnt64(doubled))
+					+ ISOLATED * static_cast<int>(__popcnt64(isolated))
+					+ BACKWARD * static_cast<int>(__popcnt64(backward));
+
+		Bitboard bb = passed;
+		Bitloop(bb)
+		{
+			int row = static_cast<int>(SquareOf(bb)) >> 3; // 0 is the 8th rank
+			score += PASSED[White ? 7 - row : row];
+		}
+
+		return score;
+	}
+}
+
+struct PawnEntry
+{
+	uint64_t key = 0;
+	Score score{};                     // Pawn structure terms from white's point of view
+	Bitboard passedPawns[2] = {};
+	Bitboard attackSpans[2] = {};
+};
+
+// Pawn structure cache, one per search thread so it needs no locking. Pawn structures change far less often than
+// the position, most probes hit. A zeroed entry is the correct one for a board without pawns (pawn key 0)
+class PawnTable
+{
+public:
+	static constexpr size_t ENTRY_COUNT = 8192; // 384KB, a power of two so the key can be masked
+
+	PawnTable() : entries(ENTRY_COUNT) {}
+
+	__forceinline const PawnEntry& probe(const BoardState& board)
+	{
+		PawnEntry& entry = entries[board.pawnKey & (ENTRY_COUNT - 1)];
+		if (entry.key != board.pawnKey)
+		{
+			entry.key = board.pawnKey;
+			entry.score = PawnStructure::evaluateSide<true>(board.whitePawns, board.blackPawns, entry.passedPawns[0])
+						- PawnStructure::evaluateSide<false>(board.blackPawns, board.whitePawns, entry.passedPawns[1]);
+			entry.attackSpans[0] = PawnStructure::attackSpan<true>(board.whitePawns);
+			entry.attackSpans[1] = PawnStructure::attackSpan<false>(board.blackPawns);
+		}
+		return entry;
+	}
+
+private:
+	std::vector<PawnEntry> entries;
+};
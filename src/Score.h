@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+
+
+// A middlegame and an endgame value packed into one 32 bit integer, the endgame half in the upper 16 bits.
+// Adding or subtracting two Scores handles both halves with a single integer operation, the borrow the middlegame half
+// can leave in the endgame half is undone when the endgame value is read back
+struct Score
+{
+	static constexpr int TOTAL_PHASE = 24; // Phase with every minor and major piece still on the board
+
+	constexpr Score() = default;
+	constexpr Score(int mg, int eg) : packed(static_cast<uint32_t>(eg) * 0x10000u + static_cast<uint32_t>(mg)) {}
+
+	constexpr int mg() const
+	{
+		return static_cast<int16_t>(static_cast<uint16_t>(packed));
+	}
+
+	constexpr int eg() const
+	{
+		return static_cast<int16_t>(static_cast<uint16_t>((packed + 0x8000u) >> 16));
+	}
+
+	// Blends the two halves by the game phase, a phase past TOTAL_PHASE (after promotions) counts as a full middlegame
+	constexpr int taper(int phase) const
+	{
+		phase = std::min(phase, TOTAL_PHASE);
+		return (mg() * phase + eg() * (TOTAL_PHASE - phase)) / TOTAL_PHASE;
+	}
+
+	constexpr Score operator+(Score other) const { return fromPacked(packed + other.packed); }
+	constexpr Score operator-(Score other) const { return fromPacked(packed - other.packed); }
+	constexpr Score operator-() const { return fromPacked(0u - packed); }
+	constexpr Score operator*(int factor) const { return fromPacked(packed * static_cast<uint32_t>(factor)); }
+
+	constexpr Score& operator+=(Score other) { packed += other.packed; return *this; }
+	constexpr Score& operator-=(Score other) { packed -= other.packed; return *this; }
+
+	constexpr bool operator==(const Score& other) const { return packed == other.packed; }
+	constexpr bool operator!=(const Score& other) const { return packed != other.packed; }
+
+	// For vectorised code that adds Scores as plain 32 bit integers
+	static constexpr Score fromPacked(uint32_t value)
+	{
+		Score score;
+		score.packed = value;
+		return score;
+	}
+
+private:
+	uint32_t packed = 0; // Unsigned so the wrapping arithmetic stays defined
+};
@@ -12,452 +12,461 @@
 #include <numeric>
 #include <utility>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <fstream>
 #include <iostream>
+#include <cmath>
+#include <sstream>
 
 #include "Board.h"
 #include "MoveGenerator.h"
 #include "Opening.h"
 #include "Evaluation.h"
 #include "TranspositionTable.h"
+#include "MovePicker.h"
+#include "TimeManager.h"
+#include "EvalCache.h"
+
+static constexpr int MAX_PLY = 128;
+static_assert(BoardState::HistoryStack::MAX_SEARCH_PLY >= MAX_PLY, "The board's history stack has to fit a whole search line");
+static constexpr int MATE_SCORE = 19500; // Mated at ply n scores -MATE_SCORE + n, stays inside the +-20000 root window
+static constexpr int SCORE_INFINITY = 20000;
+static constexpr int ASPIRATION_WINDOW = 25;
+static constexpr int ASPIRATION_MIN_DEPTH = 4;
+static constexpr int NULL_MOVE_MIN_DEPTH = 3;
+static constexpr int LMR_MIN_DEPTH = 3;
+static constexpr int LMR_MIN_MOVES = 3; // The first few moves are always searched at full depth
+
+// Late move reductions indexed by [depth][moves searched], grows with the log of both
+static const std::array<std::array<uint8_t, 64>, 64> LMR_TABLE = []
+{
+	std::array<std::array<uint8_t, 64>, 64> table{};
 
-#define SEARCH_LOGS
+	for (int depth = 1; depth < 64; ++depth)
+	{
+		for (int moveNumber = 1; moveNumber < 64; ++moveNumber)
+		{
+			table[depth][moveNumber] = static_cast<uint8_t>(0.75 + std::log(depth) * std::log(moveNumber) / 2.25);
+		}
+	}
 
-class Searcher
+	return table;
+}();
+
+// One Lazy SMP search thread. Every worker owns its own copy of the root position and its own move ordering state,
+// the only thing shared between workers is the transposition table (and the timeout flag).
+// The timeout flag is only read every TimeManager::CHECK_INTERVAL nodes, in between the worker checks its own copy
+class SearchWorker
 {
 public:
-	static constexpr int MAX_IMPLEMENTED_DEPTH = 40;
+	SearchWorker(TranspositionTable& ttTable, std::atomic<bool>& timeout, TimeManager& timeManager, size_t threadId)
+		: threadId(threadId), bestMove{}, bestEval{ INT_MIN }, completedDepth{ 0 }, ttTable(ttTable), timeout(timeout), timeManager(timeManager),
+		  board{}, maxDepth{ 0 }, bestMoveThisIteration{}, bestEvalThisIteration{ INT_MIN }
+	{
+		// The main worker (id 0) searches on the caller's thread, helpers park on their own thread until woken up
+		if (threadId != 0) thread = std::thread(&SearchWorker::idleLoop, this);
+	}
+
+	~SearchWorker()
+	{
+		if (!thread.joinable()) return;
 
-	Searcher()
-		: rng(dev()), dist(0, 3), openingBookEntries{}, timeout{ false }, bestEval{ INT_MIN }, bestMove{}, bestMoveThisIteration{}, bestEvalThisIteration{ INT_MIN }, ttTable(128)
-    {
-		#ifdef SEARCH_LOGS
-		logFile = std::ofstream("search_logs.txt", std::ios::app);
-		if (!logFile)
 		{
-			std::cerr << "Error opening log file!" << std::endl;
+			std::lock_guard<std::mutex> lock(mutex);
+			exitRequested = true;
+			searching = true;
 		}
-		#endif // SEARCH_LOGS
+		cv.notify_all();
+		thread.join();
 	}
 
-	~Searcher()
+	SearchWorker(const SearchWorker&) = delete;
+	SearchWorker& operator=(const SearchWorker&) = delete;
+
+	// Runs the whole iterative deepening loop on the calling thread
+	void search(const BoardState& rootBoard, int depthLimit)
 	{
-		#ifdef SEARCH_LOGS
-		logFile.close();
-		#endif // SEARCH_LOGS
+		board = rootBoard;
+		maxDepth = depthLimit;
+		iterativeDeepening();
 	}
 
-	void loadOpeningBook(const std::string& filename) 
+	// Wakes up a helper thread, the search itself happens on the helper's own thread
+	void startSearching(const BoardState& rootBoard, int depthLimit)
 	{
-        try 
-		{
-            openingBookEntries = loadPolyglotBook(filename);
-			std::cout << "Book Loaded Successfully" << "\n";
-        }
-		catch (const std::exception& e) 
 		{
-            std::cerr << "Failed to load opening book: " << e.what() << std::endl;
-        }
-    }
+			std::lock_guard<std::mutex> lock(mutex);
+			board = rootBoard;
+			maxDepth = depthLimit;
+			searching = true;
+		}
+		cv.notify_all();
+	}
 
-	Move findBestMove(BoardState& board, int maxDepth, int timeLimit)
+	void waitForSearchFinished()
 	{
-		#ifdef SEARCH_LOGS
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [this] { return !searching; });
+	}
 
-		Timer timer;
-		timer.start();
-		logFile << "\n ----Search Start---- \n";
-		logFile << "Max depth of: " << std::dec << maxDepth << " - Max time allowed: " << timeLimit << "ms \n";
+	size_t threadId;
 
-		#endif // SEARCH_LOGS
+	Move bestMove;
+	int bestEval;
+	int completedDepth;
 
-		Move bookMove = getBookMove(board);
-		if (!bookMove.isNull())
+	// Written only by the worker itself, the main worker reads every thread's count for the info lines
+	std::atomic<uint64_t> evaluatedNodes{ 0 };
+
+	// Only set for the main worker
+	std::ofstream* logFile = nullptr; // Null unless the search log is switched on
+	const std::vector<std::unique_ptr<SearchWorker>>* pool = nullptr;
+
+	// Principal variation of the last iteration that updated the best move, pv[0] is bestMove
+	std::array<Move, MAX_PLY + 1> pv{};
+	int pvLength = 0;
+
+private:
+	struct SearchStackEntry
+	{
+		MoveArr moves;                // Legal moves generated at this ply, owned by the ply's MovePicker
+		std::array<int, 218> scores;  // Ordering score for each move
+		bool inCheck;
+		Move killers[2];              // Quiet moves that caused a beta cutoff at this ply
+		int staticEval;
+		Move currentMove;             // Move being searched from this ply
+		Move pv[MAX_PLY + 1];         // Best line found from this ply, one row of the triangular PV table
+		int pvLength;
+	};
+
+	void idleLoop()
+	{
+		while (true)
 		{
-			#ifdef SEARCH_LOGS
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [this] { return searching; });
 
-			timer.stop();
-			logFile << '\n';
-			logFile << "Search skipped... Move found in opening table.\n";
-			logFile << "Best move is " << moveToUCI(bookMove) << "\n";
-			logFile << " ----Search End----\n";
-			logFile.flush();
+			if (exitRequested) return;
 
-			#endif // SEARCH_LOGS
+			lock.unlock();
+			iterativeDeepening();
+			lock.lock();
 
-			return bookMove;
+			searching = false;
+			cv.notify_all();
 		}
+	}
 
-		timeout = false;
-		std::thread timerThread(&Searcher::beginTimeout, this, timeLimit);
-		timerThread.detach();
-
-		int currentSearchDepth = 1;
+	void iterativeDeepening()
+	{
+		bestMove = Move{};
+		bestEval = INT_MIN;
+		completedDepth = 0;
+		pvLength = 0;
+		stack[0].pvLength = 0;
 
-		maxDepth = std::min<int>(MAX_IMPLEMENTED_DEPTH, maxDepth);
+		selDepth = 0;
+		nodesUntilCheck = nodesUntilNextCheck();
+		stopped = false;
 
-        for (; currentSearchDepth <= maxDepth; ++currentSearchDepth)
-        {
-            bestMoveThisIteration = Move{};
-            bestEvalThisIteration = INT_MIN;
+		int bestMoveStability = 0; // Iterations in a row that ended on the same best move
 
-			#ifdef SEARCH_LOGS
-			evaluatedNodes = 0; 
-			#endif
+		for (auto& entry : stack)
+		{
+			entry.killers[0] = Move{};
+			entry.killers[1] = Move{};
+		}
+		quietHistory.clear();
 
-            startIterativeSearch(board, currentSearchDepth, board.whiteTurn);
+		// Checkmate or stalemate, there is nothing to search and the aspiration loop would never see a score
+		if (!hasLegalMove())
+		{
+			bestEval = moveGenerator.inCheck ? -MATE_SCORE : 0; // Left behind by the move generation
+			if (threadId == 0) reportIteration(0);
+			return;
+		}
 
-            if (!bestMoveThisIteration.isNull())
-            {
-                bestMove = bestMoveThisIteration;
-                bestEval = bestEvalThisIteration;
-
-				#ifdef SEARCH_LOGS
-				int timeElapsed = static_cast<int>(timer.elapsedTime<std::chrono::milliseconds>());
-				timer.stop();
-				logFile << "Iteration depth: " << currentSearchDepth 
-						<< " Best move so far: " << moveToUCI(bestMove) 
-						<< " with evaluation of " << bestEval 
-						<< " for " << (board.whiteTurn ? "white" : "black") 
-						<< ". Time Elapsed: " << timeElapsed << "ms"
-						<< " Nodes evaluated: " << std::dec << evaluatedNodes << "\n"; 
-				#endif
-            }
+		// Odd helpers skip the first iteration so the threads don't walk the tree in lockstep
+		int startDepth = 1 + static_cast<int>(threadId & 1);
 
-            if (timeout) break;
-        }
+		for (int currentSearchDepth = startDepth; currentSearchDepth <= maxDepth; ++currentSearchDepth)
+		{
+			bestMoveThisIteration = Move{};
+			bestEvalThisIteration = INT_MIN;
 
+			// Aspiration window: expect the score to stay close to the last iteration's, every root move that can't beat
+			// that window is refuted far quicker. When the score lands outside it the window is widened and searched again
+			int delta = ASPIRATION_WINDOW;
+			int alpha = -SCORE_INFINITY;
+			int beta = SCORE_INFINITY;
 
-		#ifdef SEARCH_LOGS
+			if (currentSearchDepth >= ASPIRATION_MIN_DEPTH && bestEval != INT_MIN && std::abs(bestEval) < MATE_SCORE - MAX_PLY)
+			{
+				alpha = std::max(bestEval - delta, -SCORE_INFINITY);
+				beta = std::min(bestEval + delta, SCORE_INFINITY);
+			}
 
-		timer.stop();
-		logFile << '\n';
-		logFile << "Search fully completed up to depth: " << currentSearchDepth << " Time taken: " << static_cast<int>(timer.elapsedTime<std::chrono::milliseconds>()) << "ms\n";
-		logFile << "Best move is " << moveToUCI(bestMove) << " - Eval: " << bestEval << "\n";
-		logFile << " ----Search End----\n";
-		logFile.flush();
+			while (true)
+			{
+				int score = startIterativeSearch(board, currentSearchDepth, board.whiteTurn, alpha, beta);
+				if (stopped) break;
 
-		#endif // SEARCH_LOGS
+				// Inside the window, or outside a side of it that is already fully open and can't be widened
+				if ((score > alpha && score < beta) || (score <= alpha && alpha == -SCORE_INFINITY) || (score >= beta && beta == SCORE_INFINITY)) break;
 
+				// The re-search would be stopped straight away, the failed window's result doesn't complete the depth
+				if (timeout.load(std::memory_order_relaxed))
+				{
+					stopped = true;
+					break;
+				}
 
-        return bestMove;
-	}
+				if (score <= alpha)
+				{
+					beta = (alpha + beta) / 2;
+					alpha = std::max(score - delta, -SCORE_INFINITY);
+				}
+				else
+				{
+					beta = std::min(score + delta, SCORE_INFINITY);
+				}
 
-private:
-	void beginTimeout(int timeoutMS) 
-	{
-		auto start = std::chrono::steady_clock::now();
-		while (!timeout.load(std::memory_order_relaxed)) {
-			auto elapsed = std::chrono::steady_clock::now() - start;
-			if (std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() >= timeoutMS) {
-				timeout.store(true, std::memory_order_release);
-				break;
+				delta += delta / 2;
 			}
-			std::this_thread::sleep_for(std::chrono::milliseconds(5));
-		}
-	}
 
-	template<int Depth>
-    void orderMoves(MoveArr& moves, Move& previousBest, int moveCount, const BoardState& board)
-	{
-		struct MoveScore 
-		{
-			Move move;
-			int score;
-			bool operator>(const MoveScore& other) const { return score > other.score; }
-		};
-		
-		Move hashedMove{};
-		auto& data = ttTable.retrieve(board.zobristKey);
-		hashedMove = data.move;
-		
-		std::array<MoveScore, 218> moveScores;
-
-		for (int i = 0; i < moveCount; ++i) {
-			moveScores[i].move = moves[i];
-			int score = 0;
-
-			// Previous best move gets priority
-			if (moves[i] == previousBest || moves[i] == hashedMove)
+			if (!bestMoveThisIteration.isNull())
 			{
-				score = INT_MAX - 10;
-			}
-			else 
-			{
-				// Score calculation logic
-				if (moves[i].captureFlag) 
-				{
-					uint8_t victim = Evaluation::getCapturedPieceType(board, moves[i]);
-					score += 10000 + (Evaluation::getPieceValue(victim) * 10)
-						   - Evaluation::getPieceValue(moves[i].piece);
-				}
-				
-				if (moves[i].promotedPiece != Piece::NONE) 
+				bool sameBestMove = bestMoveThisIteration == bestMove;
+				int scoreDrop = bestEval == INT_MIN ? 0 : bestEval - bestEvalThisIteration;
+
+				bestMove = bestMoveThisIteration;
+				bestEval = bestEvalThisIteration;
+				if (!stopped) completedDepth = currentSearchDepth;
+
+				pvLength = stack[0].pvLength;
+				std::copy(stack[0].pv, stack[0].pv + pvLength, pv.begin());
+
+				if (threadId == 0 && !stopped)
 				{
-					score += 5000 + Evaluation::getPieceValue(moves[i].promotedPiece);
+					bestMoveStability = sameBestMove ? bestMoveStability + 1 : 0;
+					timeManager.update(bestMoveStability, scoreDrop);
 				}
+
+				if (threadId == 0) reportIteration(currentSearchDepth);
 			}
-			
-			moveScores[i].score = score;
-		}
 
-		std::sort(moveScores.begin(), moveScores.begin() + moveCount, std::greater<>());
+			if (stopped) break;
 
-		for (int i = 0; i < moveCount; ++i) 
-		{
-			moves[i] = moveScores[i].move;
+			// Only the main thread keeps time, stopping it stops the helpers as well
+			if (threadId == 0 && timeManager.softLimitReached())
+			{
+				timeout.store(true, std::memory_order_relaxed);
+				break;
+			}
 		}
 	}
 
-	Move getBookMove(const BoardState& board) 
+	bool hasLegalMove()
 	{
-        if (openingBookEntries.empty()) return Move{};
+		if (board.whiteTurn) return moveGenerator.generateLegalMoves<true>(stack[0].moves, board) != 0;
+		else return moveGenerator.generateLegalMoves<false>(stack[0].moves, board) != 0;
+	}
 
-        uint64_t key = computePolyglotHash(board);
+	// Sends the uci info line for a finished (or stopped) iteration, and mirrors it to the search log when that is on
+	void reportIteration(int depth)
+	{
+		uint64_t nodes = 0;
+		for (const auto& worker : *pool) nodes += worker->evaluatedNodes.load(std::memory_order_relaxed);
 
-        auto [lower, upper] = lookupEntries(openingBookEntries, key);
-        if (lower == upper) return Move{};
+		int64_t time = timeManager.searchTimeMS();
 
+		std::ostringstream info;
+		info << "info depth " << depth << " seldepth " << selDepth;
 
-        std::vector<TableEntry> possibleEntries(lower, upper);
-        std::vector<Move> validMoves;
-        std::vector<uint16_t> weights;
+		if (bestEval >= MATE_SCORE - MAX_PLY) info << " score mate " << (MATE_SCORE - bestEval + 1) / 2;
+		else if (bestEval <= -MATE_SCORE + MAX_PLY) info << " score mate " << -(MATE_SCORE + bestEval) / 2;
+		else info << " score cp " << bestEval;
 
-        MoveGenerator mg;
-        MoveArr legalMoves;
+		// Within the first millisecond nps would be meaningless
+		info << " nodes " << nodes;
+		if (time > 0) info << " nps " << nodes * 1000 / time;
+		info << " hashfull " << ttTable.hashfull() << " time " << time << " pv";
+		for (int i = 0; i < pvLength; ++i) info << ' ' << moveToUCI(pv[i]);
 
-		int moveCount;
-        if (board.whiteTurn) moveCount = mg.generateLegalMoves<true>(legalMoves, const_cast<BoardState&>(board));
-		else moveCount = mg.generateLegalMoves<false>(legalMoves, const_cast<BoardState&>(board));
+		// One write per line, the uci thread may be printing at the same time
+		info << '\n';
+		std::cout << info.str() << std::flush;
 
-        for (const auto& entry : possibleEntries) 
-		{
-            Move bookMove = convertPolyglotMove(entry.move, board.whiteTurn);
+		if (logFile) *logFile << info.str();
+	}
 
-            for (int i = 0; i < moveCount; ++i) 
-			{
-                const Move& legalMove = legalMoves[i];
-                if (legalMove.startSquare == bookMove.startSquare &&
-                    legalMove.endSquare == bookMove.endSquare &&
-                    legalMove.promotedPiece == bookMove.promotedPiece) 
-				{
-					//std::cout << "found valid move" << std::endl;
-                    validMoves.push_back(legalMove);
-                    weights.push_back(entry.weight);
-                    break;
-                }
-            }
-        }
+	// Makes the child's line, prefixed by move, the best line from this ply
+	static __forceinline void updatePV(SearchStackEntry& entry, const SearchStackEntry& child, const Move& move)
+	{
+		entry.pv[0] = move;
+		std::copy(child.pv, child.pv + child.pvLength, entry.pv + 1);
+		entry.pvLength = child.pvLength + 1;
+	}
 
-        if (validMoves.empty()) return Move{};
+	// The relaxed store is a plain add on x86, but keeps the main worker's read for the info lines well defined
+	__forceinline void countNode()
+	{
+		evaluatedNodes.store(evaluatedNodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
 
-        uint32_t totalWeight = std::accumulate(weights.begin(), weights.end(), 0u);
-        if (totalWeight == 0) return Move{};
+	// Static evaluation for the side to move, looked up in the eval cache before evaluating
+	template<bool Turn>
+	__forceinline int staticEval(const BoardState& board)
+	{
+		int eval;
+		if (!evalCache.probe(board.zobristKey, eval))
+		{
+			eval = Evaluation::evaluate<true>(board, pawnTable);
+			evalCache.store(board.zobristKey, eval);
+		}
+		return Turn ? eval : -eval;
+	}
 
-        std::uniform_int_distribution<uint32_t> dist(0, totalWeight - 1);
-        uint32_t r = dist(rng);
-        uint32_t cumulative = 0;
+	__forceinline void storeKiller(SearchStackEntry& entry, const Move& move)
+	{
+		if (move.captureFlag || move.promotedPiece != Piece::NONE || move == entry.killers[0]) return;
 
-        for (size_t i = 0; i < validMoves.size(); ++i)
-		{
-            cumulative += weights[i];
-            if (r < cumulative) return validMoves[i];
-        }
+		entry.killers[1] = entry.killers[0];
+		entry.killers[0] = move;
+	}
 
-        return Move{};
-    }
+	// Rewards the quiet move that caused a cutoff and punishes the quiet moves searched before it
+	template<bool Turn>
+	__forceinline void updateQuietHistory(const Move& move, const Move& previousMove, int depth, const Move* quietsTried, int quietCount)
+	{
+		int bonus = std::min(32 * depth * depth, 1200);
 
-    inline void startIterativeSearch(BoardState& board, int depth, bool turn)
-    {
-        MoveGenerator mg{};
-        MoveArr moves{};
+		quietHistory.update<Turn>(move, bonus);
+		for (int i = 0; i < quietCount; ++i)
+		{
+			quietHistory.update<Turn>(quietsTried[i], -bonus);
+		}
 
-        int moveCount;
-        if (turn)
-			moveCount = mg.generateLegalMoves<true>(moves, board);
-        else 
-			moveCount = mg.generateLegalMoves<false>(moves, board);
+		quietHistory.storeCounterMove(previousMove, move);
+	}
 
+	// Counts down to the next look at the clock and the shared timeout flag, in between only the worker's own flag is read
+	__forceinline bool shouldStop()
+	{
+		if (stopped) return true;
+		if (--nodesUntilCheck > 0) return false;
 
-		// We can do this as order moves does a null check on best move for us, if it is not null we search it first
-		switch (depth)
+		if (threadId == 0)
 		{
-		case 0: throw std::runtime_error("You cannot start a search with a depth of 0"); break;
-		case 1: orderMoves<1>(moves, bestMove, moveCount, board); break;
-		case 2: orderMoves<2>(moves, bestMove, moveCount, board); break;
-		case 3: orderMoves<3>(moves, bestMove, moveCount, board); break;
-		case 4: orderMoves<4>(moves, bestMove, moveCount, board); break;
-		case 5: orderMoves<5>(moves, bestMove, moveCount, board); break;
-		case 6: orderMoves<6>(moves, bestMove, moveCount, board); break;
-		case 7: orderMoves<7>(moves, bestMove, moveCount, board); break;
-		case 8: orderMoves<8>(moves, bestMove, moveCount, board); break;
-		case 9: orderMoves<9>(moves, bestMove, moveCount, board); break;
-		case 10: orderMoves<10>(moves, bestMove, moveCount, board); break;
-		case 11: orderMoves<11>(moves, bestMove, moveCount, board); break;
-		case 12: orderMoves<12>(moves, bestMove, moveCount, board); break;
-		case 13: orderMoves<13>(moves, bestMove, moveCount, board); break;
-		case 14: orderMoves<14>(moves, bestMove, moveCount, board); break;
-		case 15: orderMoves<15>(moves, bestMove, moveCount, board); break;
-		case 16: orderMoves<16>(moves, bestMove, moveCount, board); break;
-		case 17: orderMoves<17>(moves, bestMove, moveCount, board); break;
-		case 18: orderMoves<18>(moves, bestMove, moveCount, board); break;
-		case 19: orderMoves<19>(moves, bestMove, moveCount, board); break;
-		case 20: orderMoves<20>(moves, bestMove, moveCount, board); break;
-		case 21: orderMoves<21>(moves, bestMove, moveCount, board); break;
-		case 22: orderMoves<22>(moves, bestMove, moveCount, board); break;
-		case 23: orderMoves<23>(moves, bestMove, moveCount, board); break;
-		case 24: orderMoves<24>(moves, bestMove, moveCount, board); break;
-		case 25: orderMoves<25>(moves, bestMove, moveCount, board); break;
-		case 26: orderMoves<26>(moves, bestMove, moveCount, board); break;
-		case 27: orderMoves<27>(moves, bestMove, moveCount, board); break;
-		case 28: orderMoves<28>(moves, bestMove, moveCount, board); break;
-		case 29: orderMoves<29>(moves, bestMove, moveCount, board); break;
-		case 30: orderMoves<30>(moves, bestMove, moveCount, board); break;
-		case 31: orderMoves<31>(moves, bestMove, moveCount, board); break;
-		case 32: orderMoves<32>(moves, bestMove, moveCount, board); break;
-		case 33: orderMoves<33>(moves, bestMove, moveCount, board); break;
-		case 34: orderMoves<34>(moves, bestMove, moveCount, board); break;
-		case 35: orderMoves<35>(moves, bestMove, moveCount, board); break;
-		case 36: orderMoves<36>(moves, bestMove, moveCount, board); break;
-		case 37: orderMoves<37>(moves, bestMove, moveCount, board); break;
-		case 38: orderMoves<38>(moves, bestMove, moveCount, board); break;
-		case 39: orderMoves<39>(moves, bestMove, moveCount, board); break;
-		case 40: orderMoves<40>(moves, bestMove, moveCount, board); break;
-		default: throw std::runtime_error("Depth exceeds supported limit"); break;
+			uint64_t nodeLimit = timeManager.nodeLimitCount();
+			if (timeManager.hardLimitReached() || (nodeLimit && evaluatedNodes >= nodeLimit)) timeout.store(true, std::memory_order_relaxed);
 		}
 
-        int alpha = -20000;
-		int beta = 20000;
+		nodesUntilCheck = nodesUntilNextCheck();
+		stopped = timeout.load(std::memory_order_relaxed);
+		return stopped;
+	}
+
+	// A node limit is checked exactly. Searches limited by nodes run on the main worker alone (see Searcher::runPreparedSearch),
+	// so its own count is the whole search and the result can be reproduced
+	__forceinline uint64_t nodesUntilNextCheck() const
+	{
+		uint64_t nodeLimit = timeManager.nodeLimitCount();
+		if (threadId != 0 || !nodeLimit || evaluatedNodes >= nodeLimit) return TimeManager::CHECK_INTERVAL;
 
-        for (int i = 0; i < moveCount; ++i)
+		return std::min(TimeManager::CHECK_INTERVAL, nodeLimit - evaluatedNodes);
+	}
+
+	// Mate scores are stored relative to the node rather than the root, so the same entry is valid at any ply
+	static __forceinline int scoreToTT(int score, int ply)
+	{
+		if (score >= MATE_SCORE - MAX_PLY) return score + ply;
+		if (score <= -MATE_SCORE + MAX_PLY) return score - ply;
+		return score;
+	}
+
+	static __forceinline int scoreFromTT(int score, int ply)
+	{
+		if (score >= MATE_SCORE - MAX_PLY) return score - ply;
+		if (score <= -MATE_SCORE + MAX_PLY) return score + ply;
+		return score;
+	}
+
+    inline int startIterativeSearch(BoardState& board, int depth, bool turn, int alpha, int beta)
+    {
+		if (turn) return searchRoot<true>(board, depth, alpha, beta);
+		else return searchRoot<false>(board, depth, alpha, beta);
+	}
+
+	// Returns the best score, which is only an upper bound if it is <= alpha and a lower bound if it is >= beta.
+	// The best move is only recorded for scores above alpha, a move from a failed low window could be anything
+	template<bool Turn>
+	int searchRoot(BoardState& board, int depth, int alpha, int beta)
+	{
+		SearchStackEntry& entry = stack[0];
+
+		// The best move found so far is searched first (this iteration's if a window was re-searched), before the first
+		// iteration the table may still know one
+		const Move& previousBest = bestMoveThisIteration.isNull() ? bestMove : bestMoveThisIteration;
+		uint16_t firstMove = previousBest.isNull() ? ttTable.retrieve(board.zobristKey).move : TTEntry::packMove(previousBest);
+		MovePicker<Turn> picker(moveGenerator, board, entry.moves, entry.scores, firstMove, entry.killers, quietHistory, Move{}, false);
+
+		int bestScore = -SCORE_INFINITY;
+		bool pvMove = true;
+
+		for (Move move = picker.next(); !move.isNull(); move = picker.next())
         {
-            auto& move = moves[i];
             int score;
 
+			entry.currentMove = move;
             board.makeMove(move);
-            
-            switch (!turn)
-			{
-			case true:
-				switch (depth - 1)
-				{
-				case 0:  score = -negamax<true, 0>(board, -beta, -alpha); break;
-				case 1:  score = -negamax<true, 1>(board, -beta, -alpha); break;
-				case 2:  score = -negamax<true, 2>(board, -beta, -alpha); break;
-				case 3:  score = -negamax<true, 3>(board, -beta, -alpha); break;
-				case 4:  score = -negamax<true, 4>(board, -beta, -alpha); break;
-				case 5:  score = -negamax<true, 5>(board, -beta, -alpha); break;
-				case 6:  score = -negamax<true, 6>(board, -beta, -alpha); break;
-				case 7:  score = -negamax<true, 7>(board, -beta, -alpha); break;
-				case 8:  score = -negamax<true, 8>(board, -beta, -alpha); break;
-				case 9:  score = -negamax<true, 9>(board, -beta, -alpha); break;
-				case 10: score = -negamax<true, 10>(board, -beta, -alpha); break;
-				case 11: score = -negamax<true, 11>(board, -beta, -alpha); break;
-				case 12: score = -negamax<true, 12>(board, -beta, -alpha); break;
-				case 13: score = -negamax<true, 13>(board, -beta, -alpha); break;
-				case 14: score = -negamax<true, 14>(board, -beta, -alpha); break;
-				case 15: score = -negamax<true, 15>(board, -beta, -alpha); break;
-				case 16: score = -negamax<true, 16>(board, -beta, -alpha); break;
-				case 17: score = -negamax<true, 17>(board, -beta, -alpha); break;
-				case 18: score = -negamax<true, 18>(board, -beta, -alpha); break;
-				case 19: score = -negamax<true, 19>(board, -beta, -alpha); break;
-				case 20: score = -negamax<true, 20>(board, -beta, -alpha); break;
-				case 21: score = -negamax<true, 21>(board, -beta, -alpha); break;
-				case 22: score = -negamax<true, 22>(board, -beta, -alpha); break;
-				case 23: score = -negamax<true, 23>(board, -beta, -alpha); break;
-				case 24: score = -negamax<true, 24>(board, -beta, -alpha); break;
-				case 25: score = -negamax<true, 25>(board, -beta, -alpha); break;
-				case 26: score = -negamax<true, 26>(board, -beta, -alpha); break;
-				case 27: score = -negamax<true, 27>(board, -beta, -alpha); break;
-				case 28: score = -negamax<true, 28>(board, -beta, -alpha); break;
-				case 29: score = -negamax<true, 29>(board, -beta, -alpha); break;
-				case 30: score = -negamax<true, 30>(board, -beta, -alpha); break;
-				case 31: score = -negamax<true, 31>(board, -beta, -alpha); break;
-				case 32: score = -negamax<true, 32>(board, -beta, -alpha); break;
-				case 33: score = -negamax<true, 33>(board, -beta, -alpha); break;
-				case 34: score = -negamax<true, 34>(board, -beta, -alpha); break;
-				case 35: score = -negamax<true, 35>(board, -beta, -alpha); break;
-				case 36: score = -negamax<true, 36>(board, -beta, -alpha); break;
-				case 37: score = -negamax<true, 37>(board, -beta, -alpha); break;
-				case 38: score = -negamax<true, 38>(board, -beta, -alpha); break;
-				case 39: score = -negamax<true, 39>(board, -beta, -alpha); break;
-				default:
-                    throw std::runtime_error("Requested depth is not yet implemented!");
-					break;
-				}
-				break;
+			ttTable.prefetch(board.zobristKey);
 
-			case false:
-				switch (depth - 1)
-				{
-				case 0:  score = -negamax<false, 0>(board, -beta, -alpha); break;
-				case 1:  score = -negamax<false, 1>(board, -beta, -alpha); break;
-				case 2:  score = -negamax<false, 2>(board, -beta, -alpha); break;
-				case 3:  score = -negamax<false, 3>(board, -beta, -alpha); break;
-				case 4:  score = -negamax<false, 4>(board, -beta, -alpha); break;
-				case 5:  score = -negamax<false, 5>(board, -beta, -alpha); break;
-				case 6:  score = -negamax<false, 6>(board, -beta, -alpha); break;
-				case 7:  score = -negamax<false, 7>(board, -beta, -alpha); break;
-				case 8:  score = -negamax<false, 8>(board, -beta, -alpha); break;
-				case 9:  score = -negamax<false, 9>(board, -beta, -alpha); break;
-				case 10: score = -negamax<false, 10>(board, -beta, -alpha); break;
-				case 11: score = -negamax<false, 11>(board, -beta, -alpha); break;
-				case 12: score = -negamax<false, 12>(board, -beta, -alpha); break;
-				case 13: score = -negamax<false, 13>(board, -beta, -alpha); break;
-				case 14: score = -negamax<false, 14>(board, -beta, -alpha); break;
-				case 15: score = -negamax<false, 15>(board, -beta, -alpha); break;
-				case 16: score = -negamax<false, 16>(board, -beta, -alpha); break;
-				case 17: score = -negamax<false, 17>(board, -beta, -alpha); break;
-				case 18: score = -negamax<false, 18>(board, -beta, -alpha); break;
-				case 19: score = -negamax<false, 19>(board, -beta, -alpha); break;
-				case 20: score = -negamax<false, 20>(board, -beta, -alpha); break;
-				case 21: score = -negamax<false, 21>(board, -beta, -alpha); break;
-				case 22: score = -negamax<false, 22>(board, -beta, -alpha); break;
-				case 23: score = -negamax<false, 23>(board, -beta, -alpha); break;
-				case 24: score = -negamax<false, 24>(board, -beta, -alpha); break;
-				case 25: score = -negamax<false, 25>(board, -beta, -alpha); break;
-				case 26: score = -negamax<false, 26>(board, -beta, -alpha); break;
-				case 27: score = -negamax<false, 27>(board, -beta, -alpha); break;
-				case 28: score = -negamax<false, 28>(board, -beta, -alpha); break;
-				case 29: score = -negamax<false, 29>(board, -beta, -alpha); break;
-				case 30: score = -negamax<false, 30>(board, -beta, -alpha); break;
-				case 31: score = -negamax<false, 31>(board, -beta, -alpha); break;
-				case 32: score = -negamax<false, 32>(board, -beta, -alpha); break;
-				case 33: score = -negamax<false, 33>(board, -beta, -alpha); break;
-				case 34: score = -negamax<false, 34>(board, -beta, -alpha); break;
-				case 35: score = -negamax<false, 35>(board, -beta, -alpha); break;
-				case 36: score = -negamax<false, 36>(board, -beta, -alpha); break;
-				case 37: score = -negamax<false, 37>(board, -beta, -alpha); break;
-				case 38: score = -negamax<false, 38>(board, -beta, -alpha); break;
-				case 39: score = -negamax<false, 39>(board, -beta, -alpha); break;
-				default:
-                    throw std::runtime_error("Requested depth is not yet implemented!");
-                    break;
-				}
-				break;
+			if (pvMove)
+			{
+				score = -negamax<!Turn>(board, depth - 1, 1, -beta, -alpha);
+				pvMove = false;
+			}
+			else
+			{
+				score = -negamax<!Turn>(board, depth - 1, 1, -alpha - 1, -alpha);
+				if (score > alpha && score < beta) score = -negamax<!Turn>(board, depth - 1, 1, -beta, -alpha);
 			}
 
             board.unmakeMove();
 
-			if (timeout) return;
+			if (stopped) return bestScore;
 
-            if (score > bestEvalThisIteration) 
-            {
+			bestScore = std::max(bestScore, score);
+
+			if (score > alpha)
+			{
 				bestEvalThisIteration = score;
 				bestMoveThisIteration = move;
-			}
+				updatePV(entry, stack[1], move);
+				alpha = score;
 
-			alpha = std::max(alpha, score);
-			if (alpha >= beta) break;
+				// Failing high at the root ends this window, the caller re-searches with a wider one
+				if (alpha >= beta) break;
+			}
         }
+
+		return bestScore;
     }
 
-	template<bool Turn, int Depth>
-    int negamax(BoardState& board, int alpha, int beta)
+	template<bool Turn>
+    int negamax(BoardState& board, int depth, int ply, int alpha, int beta)
     {
-		if (timeout) return 0;
+		if (depth <= 0) return quiescence<Turn>(board, ply, alpha, beta);
+
+		SearchStackEntry& entry = stack[ply];
+		entry.pvLength = 0;
+
+		if (shouldStop()) return 0;
 
 		int originalAlpha = alpha;
+		bool pvNode = beta - alpha > 1;
 
 		if (board.historyStack.size() >= 2)
 		{
@@ -465,18 +474,17 @@ private:
 				return -5; // draw by repetition - offset slightly prefer moves that may be more equal but don't lead to a draw
 		}
 
-		#ifdef SEARCH_LOGS
-		++evaluatedNodes; 
-		#endif
+		countNode();
+		selDepth = std::max(selDepth, ply);
 
-		TTEntry::SmpData& data = ttTable.retrieve(board.zobristKey);
-		if (data.depth >= Depth) // data.depth will be 0 if null result is found and thus it will never be used as 'Depth' is always >= 1 during the main search
-		{
-			int ttScore = data.score;
+		if (ply >= MAX_PLY) return staticEval<Turn>(board);
 
-			#ifdef SEARCH_LOGS
-				//logFile << "Found TT Entry" << "\n";
-			#endif // SEARCH_LOGS
+		TTEntry::SmpData data = ttTable.retrieve(board.zobristKey);
+		// data.depth will be 0 if null result is found and thus it will never be used as 'depth' is always >= 1 here.
+		// PV nodes are always searched, a cutoff there would leave the reported line (and the ponder move) cut short
+		if (!pvNode && data.depth >= depth)
+		{
+			int ttScore = scoreFromTT(data.score, ply);
 
 			if (data.flags == TTEntry::EXACT)
 			{
@@ -494,123 +502,499 @@ private:
 			if (alpha >= beta) return ttScore;
 		}
 
-        MoveGenerator mg;
-		MoveArr moves{};
-        int moveCount = mg.generateLegalMoves<Turn>(moves, board);
+		entry.inCheck = moveGenerator.isInCheck<Turn>(board);
 
-        if (moveCount == 0)
-        {
-            if (mg.inCheck)
-            {
-                constexpr int MATESCORE = -19000 - Depth;
-                return MATESCORE;
-            }
-            else
-            {
-                constexpr int DRAWSCORE = 0;
-                return DRAWSCORE;
-            }
-        }
+		// Null move pruning: if passing still fails high on a reduced search, a real move would too. Zugzwang breaks that
+		// assumption, so it is skipped in check, with only pawns left, and straight after another null move
+		if (!pvNode && depth >= NULL_MOVE_MIN_DEPTH && !entry.inCheck && !stack[ply - 1].currentMove.isNull()
+			&& beta < MATE_SCORE - MAX_PLY && Helpers::getNonPawnMaterial<Turn>(board))
+		{
+			entry.staticEval = staticEval<Turn>(board);
+
+			if (entry.staticEval >= beta)
+			{
+				int reduction = 2 + depth / 4;
 
-        orderMoves<Depth>(moves, bestMove, moveCount, board);
+				entry.currentMove = Move{};
+				board.makeNullMove();
+				int nullScore = -negamax<!Turn>(board, depth - 1 - reduction, ply + 1, -beta, -beta + 1);
+				board.unmakeNullMove();
+
+				if (stopped) return 0;
+
+				// An unproven mate from a null move search is not trusted
+				if (nullScore >= beta) return nullScore >= MATE_SCORE - MAX_PLY ? beta : nullScore;
+			}
+		}
+
+		const Move& previousMove = stack[ply - 1].currentMove;
+		MovePicker<Turn> picker(moveGenerator, board, entry.moves, entry.scores, data.move, entry.killers, quietHistory, quietHistory.counterMove(previousMove), false);
 
         int bestScore = -25000;
 		Move bestMoveInCurrentSearch{};
+		int movesSearched = 0;
+
+		// Quiet moves that failed to cut off, they get a history penalty once another quiet move does
+		std::array<Move, 64> quietsTried;
+		int quietCount = 0;
 
-        for (int i = 0; i < moveCount; ++i) 
+		for (Move move = picker.next(); !move.isNull(); move = picker.next())
         {
-			Move& move = moves[i];
+			++movesSearched;
+
+			bool quiet = !move.captureFlag && move.promotedPiece == Piece::NONE;
+
+			entry.currentMove = move;
 			board.makeMove(move);
-			int score = -negamax<!Turn, Depth - 1>(board, -beta, -alpha);
+			ttTable.prefetch(board.zobristKey);
+
+			int score;
+			if (movesSearched == 1)
+			{
+				score = -negamax<!Turn>(board, depth - 1, ply + 1, -beta, -alpha);
+			}
+			else
+			{
+				// Principal variation search: the later moves only have to be proven worse than the first, which a null
+				// window does far cheaper. Late quiet moves are expected to be bad enough to be searched shallower too
+				int reduction = 0;
+				if (depth >= LMR_MIN_DEPTH && movesSearched > LMR_MIN_MOVES && quiet && !entry.inCheck
+					&& move != entry.killers[0] && move != entry.killers[1] && !moveGenerator.isInCheck<!Turn>(board))
+				{
+					reduction = LMR_TABLE[std::min(depth, 63)][std::min(movesSearched, 63)];
+					if (pvNode) --reduction;
+					reduction = std::clamp(reduction, 0, depth - 2);
+				}
+
+				score = -negamax<!Turn>(board, depth - 1 - reduction, ply + 1, -alpha - 1, -alpha);
+
+				if (score > alpha && reduction > 0)
+					score = -negamax<!Turn>(board, depth - 1, ply + 1, -alpha - 1, -alpha);
+
+				if (score > alpha && score < beta)
+					score = -negamax<!Turn>(board, depth - 1, ply + 1, -beta, -alpha);
+			}
+
 			board.unmakeMove();
 
-			if (timeout) return 0;
+			if (stopped) return 0;
 
 			if (score > bestScore) 
             {
-				if (score > alpha) alpha = score;
+				if (score > alpha)
+				{
+					alpha = score;
+					if (pvNode) updatePV(entry, stack[ply + 1], move);
+				}
 
 				bestScore = score;
 				bestMoveInCurrentSearch = move;
 				
 				if (score >= beta) 
 				{
-					ttTable.store(board.zobristKey, TTEntry::SmpData{ static_cast<int16_t>(score), static_cast<uint8_t>(Depth), TTEntry::LOWERBOUND, move });
+					if (quiet)
+					{
+						storeKiller(entry, move);
+						updateQuietHistory<Turn>(move, previousMove, depth, quietsTried.data(), quietCount);
+					}
+					ttTable.store(board.zobristKey, TTEntry::makeData(scoreToTT(score, ply), depth, TTEntry::LOWERBOUND, move));
 					return score; 
 				}
 			}
-		}
 
-		TTEntry::SmpData newEntryData{};
-		newEntryData.score = bestScore;
+			if (quiet && quietCount < static_cast<int>(quietsTried.size())) quietsTried[quietCount++] = move;
+		}
 
-		if (bestScore <= originalAlpha) newEntryData.flags = TTEntry::UPPERBOUND;
-		else if (bestScore >= beta) newEntryData.flags = TTEntry::LOWERBOUND;
-		else newEntryData.flags = TTEntry::EXACT;
+		// The picker only runs out without handing out a single move when there are no legal moves at all
+        if (movesSearched == 0)
+        {
+            if (entry.inCheck)
+            {
+                return -MATE_SCORE + ply; // Shorter mates are preferred
+            }
+            else
+            {
+                constexpr int DRAWSCORE = 0;
+                return DRAWSCORE;
+            }
+        }
 
-		newEntryData.depth = Depth;
-		newEntryData.move = bestMoveInCurrentSearch;
+		uint8_t flags;
+		if (bestScore <= originalAlpha) flags = TTEntry::UPPERBOUND;
+		else if (bestScore >= beta) flags = TTEntry::LOWERBOUND;
+		else flags = TTEntry::EXACT;
 
-		ttTable.store(board.zobristKey, newEntryData);
+		ttTable.store(board.zobristKey, TTEntry::makeData(scoreToTT(bestScore, ply), depth, flags, bestMoveInCurrentSearch));
 
         return bestScore;
     }
     
     template<bool Turn>
-    int quiescence(BoardState& board, int alpha, int beta) {
-		#ifdef SEARCH_LOGS
-		++evaluatedNodes; 
-		#endif
+    int quiescence(BoardState& board, int ply, int alpha, int beta) {
+        SearchStackEntry& entry = stack[ply];
+        entry.pvLength = 0; // The reported line ends where quiescence starts
 
+		if (shouldStop()) return 0;
 
-        int standPat = Evaluation::evaluate<Turn>(board);
-        if (standPat >= beta)
-            return beta;
-        if (standPat > alpha)
-            alpha = standPat;
+		countNode();
+		selDepth = std::max(selDepth, ply);
 
-        MoveGenerator mg;
-        MoveArr moves;
-        int moveCount = mg.generateLegalMoves<Turn>(moves, board);
-
-        // Filter captures and promotions
-        MoveArr qMoves;
-        int qCount = 0;
-        for (int i = 0; i < moveCount; ++i) {
-            if (moves[i].captureFlag || moves[i].promotedPiece != Piece::NONE) {
-                qMoves[qCount++] = moves[i];
-            }
+        entry.inCheck = moveGenerator.isInCheck<Turn>(board);
+
+        if (ply >= MAX_PLY)
+            return staticEval<Turn>(board);
+
+        // Standing pat is not an option while in check, every evasion is searched instead
+        if (!entry.inCheck)
+        {
+            int standPat = staticEval<Turn>(board);
+            entry.staticEval = standPat;
+
+            if (standPat >= beta)
+                return beta;
+            if (standPat > alpha)
+                alpha = standPat;
         }
 
-        // Order moves (without previous best)
-        Move nullMove;
-        orderMoves<0>(qMoves, nullMove, qCount, board);
+        MovePicker<Turn> picker(moveGenerator, board, entry.moves, entry.scores, ttTable.retrieve(board.zobristKey).move, entry.killers, quietHistory, Move{}, true);
+        int movesSearched = 0;
 
-        for (int i = 0; i < qCount; ++i) {
-            Move& move = qMoves[i];
+        for (Move move = picker.next(); !move.isNull(); move = picker.next()) {
+            ++movesSearched;
+
+            entry.currentMove = move;
             board.makeMove(move);
-            int score = -quiescence<!Turn>(board, -beta, -alpha);
+            ttTable.prefetch(board.zobristKey);
+            int score = -quiescence<!Turn>(board, ply + 1, -beta, -alpha);
             board.unmakeMove();
 
+            if (stopped) return 0;
+
             if (score >= beta)
                 return beta;
             if (score > alpha)
                 alpha = score;
         }
 
+        if (entry.inCheck && movesSearched == 0)
+            return -MATE_SCORE + ply;
+
         return alpha;
     }
 
-	template<>
-	int negamax<true, 0>(BoardState& board, int alpha, int beta) {
-		return quiescence<true>(board, alpha, beta);
+	TranspositionTable& ttTable;
+	std::atomic<bool>& timeout;
+	TimeManager& timeManager; // Only the main worker touches it
+	uint64_t nodesUntilCheck = TimeManager::CHECK_INTERVAL;
+	bool stopped = false;
+	int selDepth = 0; // Deepest ply reached, quiescence included
+
+	BoardState board;
+	int maxDepth;
+
+	Move bestMoveThisIteration;
+	int bestEvalThisIteration;
+
+	// Preallocated per ply, nothing in the search allocates move lists on the call stack
+	std::array<SearchStackEntry, MAX_PLY + 1> stack{};
+	QuietHistory quietHistory{};
+	PawnTable pawnTable;
+	EvalCache evalCache;
+	MoveGenerator moveGenerator;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool searching = false;
+	bool exitRequested = false;
+};
+
+class Searcher
+{
+public:
+	static constexpr size_t DEFAULT_HASH_MB = 128;
+	static constexpr size_t MAX_HASH_MB = 65536;
+	static constexpr size_t MAX_THREADS = 256;
+
+	// One thread unless the GUI asks for more, like other uci engines, so several engines can share a machine
+	Searcher(size_t threadCount = 1, size_t hashSizeMB = DEFAULT_HASH_MB)
+		: rng(dev()), dist(0, 3), openingBookEntries{}, ttTable(hashSizeMB), timeout{ false }
+    {
+		setThreadCount(threadCount);
+	}
+
+	~Searcher()
+	{
+		if (logFile.is_open()) logFile.close();
+	}
+
+	// Recreates the worker pool, must not be called while a search is running
+	void setThreadCount(size_t threadCount)
+	{
+		threadCount = std::clamp<size_t>(threadCount, 1, MAX_THREADS);
+
+		workers.clear();
+		for (size_t i = 0; i < threadCount; ++i)
+		{
+			workers.push_back(std::make_unique<SearchWorker>(ttTable, timeout, timeManager, i));
+		}
+
+		workers[0]->logFile = logFile.is_open() ? &logFile : nullptr;
+		workers[0]->pool = &workers;
+	}
+
+	// Appends every search to search_logs.txt while enabled, must not be called while a search is running
+	void setSearchLog(bool enabled)
+	{
+		if (enabled && !logFile.is_open())
+		{
+			logFile.open("search_logs.txt", std::ios::app);
+			if (!logFile)
+			{
+				std::cerr << "Error opening log file!" << std::endl;
+			}
+		}
+		else if (!enabled && logFile.is_open())
+		{
+			logFile.close();
+		}
+
+		workers[0]->logFile = logFile.is_open() ? &logFile : nullptr;
+	}
+
+	// Reallocates the transposition table and zeroes it with one short lived thread per search thread
+	void setHashSize(size_t hashSizeMB)
+	{
+		ttTable.resize(std::clamp<size_t>(hashSizeMB, 1, MAX_HASH_MB), workers.size());
+	}
+
+	// Switches the table to (or away from) explicitly reserved huge pages, the table is reallocated straight away
+	void setLargePages(bool enabled)
+	{
+		ttTable.setExplicitHugePages(enabled);
+		ttTable.resize(ttTable.sizeMB(), workers.size());
+	}
+
+	// The best move may not be sent before "ponderhit" or "stop" when pondering or searching infinitely, even if the
+	// search ran out of depth or the move came from the book
+	void waitForStopOrPonderhit(const SearchLimits& limits)
+	{
+		while ((timeManager.isPondering() || limits.infinite) && !timeout.load(std::memory_order_relaxed))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	// Ends a running search as soon as the workers notice, safe to call from any thread
+	void stop()
+	{
+		timeout.store(true, std::memory_order_relaxed);
+	}
+
+	// Switches a ponder search over to the normal time limits, safe to call from any thread
+	void ponderhit()
+	{
+		timeManager.ponderhit();
+	}
+
+	// Ages every entry from the previous game so they are the first to be replaced
+	void newGame()
+	{
+		ttTable.newSearch();
+	}
+
+	size_t threadCount() const { return workers.size(); }
+	size_t hashSizeMB() const { return ttTable.sizeMB(); }
+	const char* hashPageSize() const { return ttTable.pageSizeDescription(); }
+
+	void loadOpeningBook(const std::string& filename) 
+	{
+        try 
+		{
+            openingBookEntries = loadPolyglotBook(filename);
+			std::cout << "Book Loaded Successfully" << "\n";
+        }
+		catch (const std::exception& e) 
+		{
+            std::cerr << "Failed to load opening book: " << e.what() << std::endl;
+        }
+    }
+
+	// Fixed depth and time search, used by the GUI and the tests
+	Move findBestMove(BoardState& board, int maxDepth, int timeLimit)
+	{
+		SearchLimits limits;
+		limits.depth = maxDepth;
+		limits.moveTime = timeLimit;
+
+		return findBestMove(board, limits);
+	}
+
+	Move findBestMove(BoardState& board, const SearchLimits& limits)
+	{
+		prepareSearch(limits, board.whiteTurn);
+		return runPreparedSearch(board, limits);
+	}
+
+	// Starts the clock and clears the stop flag. Split from runPreparedSearch() so a search thread can be launched after
+	// this returns, a "stop" or "ponderhit" that arrives before the thread gets going then can't be lost
+	void prepareSearch(const SearchLimits& limits, bool whiteTurn)
+	{
+		timeManager.start(limits, whiteTurn);
+		timeout = false;
+	}
+
+	Move runPreparedSearch(BoardState& board, const SearchLimits& limits)
+	{
+		int maxDepth = limits.depth > 0 ? std::min<int>(MAX_PLY - 1, limits.depth) : MAX_PLY - 1;
+		lastPonderMove = Move{};
+
+		// Helpers would make a node limit both inexact and timing dependent
+		activeWorkers = limits.nodes ? 1 : workers.size();
+
+		if (logFile.is_open())
+		{
+			logFile << "\n ----Search Start---- \n";
+			logFile << "Max depth of: " << std::dec << maxDepth << " - Time allowed: " << timeManager.softLimitMS() << "ms (hard limit " << timeManager.hardLimitMS()
+					<< "ms) - Node limit: " << limits.nodes << " - Threads: " << activeWorkers << "\n";
+		}
+
+		Move bookMove = getBookMove(board);
+		if (!bookMove.isNull())
+		{
+			if (logFile.is_open())
+			{
+				logFile << '\n';
+				logFile << "Search skipped... Move found in opening table.\n";
+				logFile << "Best move is " << moveToUCI(bookMove) << "\n";
+				logFile << " ----Search End----\n";
+				logFile.flush();
+			}
+
+			waitForStopOrPonderhit(limits);
+			return bookMove;
+		}
+
+		ttTable.newSearch();
+
+		// Reset before any worker starts, the main worker sums every count for its info lines
+		for (const auto& worker : workers) worker->evaluatedNodes = 0;
+
+		for (size_t i = 1; i < activeWorkers; ++i)
+		{
+			workers[i]->startSearching(board, maxDepth);
+		}
+
+		workers[0]->search(board, maxDepth);
+		waitForStopOrPonderhit(limits);
+
+		// Once the main thread is done the helpers are stopped as well
+		timeout = true;
+
+		for (size_t i = 1; i < activeWorkers; ++i)
+		{
+			workers[i]->waitForSearchFinished();
+		}
+
+		const SearchWorker& bestWorker = pickBestWorker();
+		if (bestWorker.pvLength >= 2) lastPonderMove = bestWorker.pv[1];
+
+		if (logFile.is_open())
+		{
+			uint64_t totalNodes = 0;
+			for (const auto& worker : workers) totalNodes += worker->evaluatedNodes;
+
+			logFile << '\n';
+			logFile << "Search fully completed up to depth: " << bestWorker.completedDepth << " (thread " << bestWorker.threadId << ") Time taken: " << timeManager.searchTimeMS() << "ms\n";
+			logFile << "Best move is " << moveToUCI(bestWorker.bestMove) << " - Eval: " << bestWorker.bestEval << " - Total nodes evaluated: " << totalNodes << "\n";
+			logFile << " ----Search End----\n";
+			logFile.flush();
+		}
+
+        return bestWorker.bestMove;
 	}
 
-	template<>
-	int negamax<false, 0>(BoardState& board, int alpha, int beta) {
-		return quiescence<false>(board, alpha, beta);
+	// The reply the last search expects to the move it returned, null when the line it found was too short
+	Move ponderMove() const { return lastPonderMove; }
+
+private:
+	// The main thread has the final say, it only defers to a helper that fully completed a deeper iteration
+	const SearchWorker& pickBestWorker() const
+	{
+		const SearchWorker* best = workers[0].get();
+
+		for (size_t i = 1; i < activeWorkers; ++i)
+		{
+			const SearchWorker* worker = workers[i].get();
+			if (worker->bestMove.isNull()) continue;
+
+			if (best->bestMove.isNull() || worker->completedDepth > best->completedDepth)
+			{
+				best = worker;
+			}
+		}
+
+		return *best;
 	}
 
+	Move getBookMove(const BoardState& board) 
+	{
+        if (openingBookEntries.empty()) return Move{};
+
+        uint64_t key = computePolyglotHash(board);
+
+        auto [lower, upper] = lookupEntries(openingBookEntries, key);
+        if (lower == upper) return Move{};
+
+
+        std::vector<TableEntry> possibleEntries(lower, upper);
+        std::vector<Move> validMoves;
+        std::vector<uint16_t> weights;
+
+        MoveGenerator mg;
+        MoveArr legalMoves;
+
+		int moveCount;
+        if (board.whiteTurn) moveCount = mg.generateLegalMoves<true>(legalMoves, const_cast<BoardState&>(board));
+		else moveCount = mg.generateLegalMoves<false>(legalMoves, const_cast<BoardState&>(board));
+
+        for (const auto& entry : possibleEntries) 
+		{
+            Move bookMove = convertPolyglotMove(entry.move, board.whiteTurn);
+
+            for (int i = 0; i < moveCount; ++i) 
+			{
+                const Move& legalMove = legalMoves[i];
+                if (legalMove.startSquare == bookMove.startSquare &&
+                    legalMove.endSquare == bookMove.endSquare &&
+                    legalMove.promotedPiece == bookMove.promotedPiece) 
+				{
+					//std::cout << "found valid move" << std::endl;
+                    validMoves.push_back(legalMove);
+                    weights.push_back(entry.weight);
+                    break;
+                }
+            }
+        }
+
+        if (validMoves.empty()) return Move{};
+
+        uint32_t totalWeight = std::accumulate(weights.begin(), weights.end(), 0u);
+        if (totalWeight == 0) return Move{};
+
+        std::uniform_int_distribution<uint32_t> dist(0, totalWeight - 1);
+        uint32_t r = dist(rng);
+        uint32_t cumulative = 0;
+
+        for (size_t i = 0; i < validMoves.size(); ++i)
+		{
+            cumulative += weights[i];
+            if (r < cumulative) return validMoves[i];
+        }
+
+        return Move{};
+    }
+
 	std::random_device dev;
     std::mt19937 rng;
     std::uniform_int_distribution<std::mt19937::result_type> dist;
@@ -620,17 +1004,12 @@ private:
 	TranspositionTable ttTable;
 
     std::atomic<bool> timeout;
-    
-    Move bestMove;
-    int bestEval;
-
-    Move bestMoveThisIteration;
-	int bestEvalThisIteration;
+	TimeManager timeManager;
 
-	#ifdef SEARCH_LOGS
-		std::ofstream logFile;
-		uint64_t evaluatedNodes = 0;
-	#endif // SEARCH_LOGS
+	std::vector<std::unique_ptr<SearchWorker>> workers;
+	size_t activeWorkers = 1; // Workers taking part in the current search, the main worker is always first
+	Move lastPonderMove{};
 
+	std::ofstream logFile; // Only open while the search log is switched on
 
 };
\ No newline at end of file
@@ -18,4 +18,74 @@ void testDepth(int depth)
 	timer.stop();
 	
 	std::cout << std::dec << timer.elapsedTime<std::chrono::milliseconds>() << "\n";
+}
+
+// Times Evaluation::sumPieceSquares against adding up the same Score with one SSE sumBonuses pass per table, and
+// checks that both agree
+inline void benchmarkPieceSquareSum(int iterations)
+{
+	using namespace Evaluation;
+
+	const std::array<const std::array<int16_t, 64>*, 6> mgTables = { &pawnBonusMiddle, &knightBonusMiddle, &bishopBonusMiddle, &rookBonusMiddle, &queenBonusMiddle, &kingBonusMiddle };
+	const std::array<const std::array<int16_t, 64>*, 6> egTables = { &pawnBonusEnd, &knightBonusEnd, &bishopBonusEnd, &rookBonusEnd, &queenBonusEnd, &kingBonusEnd };
+
+	auto sumWithSSE = [&](const BoardState& board)
+	{
+		const std::array<Bitboard, 6> white = { board.whitePawns, board.whiteKnights, board.whiteBishops, board.whiteRooks, board.whiteQueens, board.whiteKing };
+		const std::array<Bitboard, 6> black = { board.blackPawns, board.blackKnights, board.blackBishops, board.blackRooks, board.blackQueens, board.blackKing };
+
+		Score score{};
+		for (int type = 0; type < 6; ++type)
+		{
+			Bitboard blackMirrored = mirrorVertical(black[type]);
+			score += pieceScore[type] * (static_cast<int>(__popcnt64(white[type])) - static_cast<int>(__popcnt64(black[type])));
+			score += Score(sumBonuses(white[type], *mgTables[type]) - sumBonuses(blackMirrored, *mgTables[type]),
+						   sumBonuses(white[type], *egTables[type]) - sumBonuses(blackMirrored, *egTables[type]));
+		}
+		return score;
+	};
+
+	const std::array<const char*, 3> fens = {
+		"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"
+	};
+
+	for (const char* fen : fens)
+	{
+		BoardState board;
+		board.parseFEN(fen);
+
+		if (sumWithSSE(board) != sumPieceSquares(board)) std::cout << "Piece-square sums differ for " << fen << "\n";
+	}
+
+	BoardState board;
+	board.parseFEN(fens[1]);
+
+	// The checksum keeps the compiler from dropping the loops, toggling a white pawn on the empty a5 square keeps it
+	// from hoisting the sums out of them
+	constexpr Bitboard toggledPawn = 1ULL << 24;
+	int checksum = 0;
+	Timer timer;
+
+	timer.start();
+	for (int i = 0; i < iterations; ++i)
+	{
+		board.whitePawns ^= (i & 1) ? toggledPawn : 0;
+		checksum += sumWithSSE(board).mg();
+	}
+	timer.stop();
+	double sseTime = timer.elapsedTime<std::chrono::microseconds>();
+
+	timer.start();
+	for (int i = 0; i < iterations; ++i)
+	{
+		board.whitePawns ^= (i & 1) ? toggledPawn : 0;
+		checksum += sumPieceSquares(board).mg();
+	}
+	timer.stop();
+	double avxTime = timer.elapsedTime<std::chrono::microseconds>();
+
+	std::cout << std::dec << "SSE sumBonuses: " << sseTime / iterations * 1000.0 << "ns - AVX2 sumPieceSquares: " << avxTime / iterations * 1000.0
+			  << "ns per position (checksum " << checksum << ")\n";
 }
\ No newline at end of file
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+
+
+// Everything a UCI "go" command can limit the search by. Times are in milliseconds, -1 / 0 means not set
+struct SearchLimits
+{
+	int depth = 0;
+	int64_t moveTime = -1;
+	int64_t time[2] = { -1, -1 };  // Remaining clock time, indexed white = 0, black = 1
+	int64_t increment[2] = { 0, 0 };
+	int movesToGo = 0;
+	uint64_t nodes = 0;
+	bool infinite = false;
+	bool ponder = false;          // Searching on the opponent's time, the limits only apply after "ponderhit"
+};
+
+// Deadlines for one search. Nothing runs in the background, the main search thread asks hardLimitReached() every
+// CHECK_INTERVAL nodes and softLimitReached() between iterations, then raises the shared stop flag for the helpers.
+// A negative limit means there is no limit. While pondering no limit applies, the clock effectively starts at ponderhit()
+class TimeManager
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr uint64_t CHECK_INTERVAL = 2048; // Nodes between clock reads, well under a millisecond of search
+	static constexpr int64_t MOVE_OVERHEAD = 30;     // Kept back from the clock for GUI and network latency
+	static constexpr int DEFAULT_MOVES_TO_GO = 30;   // Moves the remaining clock is spread over in sudden death
+
+	void start(int64_t softLimitMS, int64_t hardLimitMS)
+	{
+		startPoint = Clock::now();
+		softLimit = baseSoftLimit = softLimitMS;
+		hardLimit = hardLimitMS;
+		adjustable = false;
+		nodeLimit = 0;
+		ponderTime = 0;
+		pondering = false;
+	}
+
+	// Splits the clock into a soft limit (the time we would like to use) and a hard limit (the most we can afford)
+	void start(const SearchLimits& limits, bool whiteTurn)
+	{
+		start(-1, -1);
+		nodeLimit = limits.nodes;
+		pondering = limits.ponder;
+
+		if (limits.infinite) return;
+
+		if (limits.moveTime >= 0)
+		{
+			softLimit = baseSoftLimit = hardLimit = limits.moveTime;
+			return;
+		}
+
+		int side = whiteTurn ? 0 : 1;
+		if (limits.time[side] < 0) return;
+
+		int64_t available = std::max<int64_t>(1, limits.time[side] - MOVE_OVERHEAD);
+		int movesToGo = limits.movesToGo > 0 ? std::min(limits.movesToGo, 50) : DEFAULT_MOVES_TO_GO;
+
+		int64_t optimum = available / movesToGo + limits.increment[side] * 3 / 4;
+
+		hardLimit = std::min(optimum * 4, available * 3 / 4);
+		softLimit = baseSoftLimit = std::min(optimum, hardLimit);
+		adjustable = true;
+	}
+
+	// Called by the main thread after every iteration. A best move that keeps changing or a score that is dropping
+	// earns more time, a best move that has been stable for several iterations gets less
+	void update(int bestMoveStability, int scoreDrop)
+	{
+		if (!adjustable) return;
+
+		static constexpr double stabilityScale[] = { 2.0, 1.4, 1.1, 0.9, 0.8, 0.7 };
+		double scale = stabilityScale[std::min(bestMoveStability, 5)];
+
+		if (scoreDrop > 0) scale *= 1.0 + std::min(scoreDrop, 100) / 100.0;
+
+		softLimit = std::min(static_cast<int64_t>(baseSoftLimit * scale), hardLimit);
+	}
+
+	// The opponent played the expected move, from now on the search runs on our own clock. Called from the UCI thread
+	void ponderhit()
+	{
+		ponderTime = elapsedMS();
+		pondering = false;
+	}
+
+	bool isPondering() const
+	{
+		return pondering.load(std::memory_order_relaxed);
+	}
+
+	// Time spent on our own clock, pondering doesn't count
+	int64_t elapsedMS() const
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - startPoint).count() - ponderTime.load(std::memory_order_relaxed);
+	}
+
+	// Wall time since the search started, pondering included
+	int64_t searchTimeMS() const
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - startPoint).count();
+	}
+
+	// Past this point there is not enough time left to expect another iteration to finish
+	bool softLimitReached() const
+	{
+		return !isPondering() && softLimit >= 0 && elapsedMS() >= softLimit;
+	}
+
+	// The search has to stop right away
+	bool hardLimitReached() const
+	{
+		return !isPondering() && hardLimit >= 0 && elapsedMS() >= hardLimit;
+	}
+
+	// 0 when the search isn't limited by nodes
+	uint64_t nodeLimitCount() const { return nodeLimit; }
+
+	int64_t softLimitMS() const { return softLimit; }
+	int64_t hardLimitMS() const { return hardLimit; }
+
+private:
+	Clock::time_point startPoint = Clock::now();
+	int64_t softLimit = -1;
+	int64_t baseSoftLimit = -1;
+	int64_t hardLimit = -1;
+	uint64_t nodeLimit = 0;
+	bool adjustable = false;
+
+	std::atomic<int64_t> ponderTime{ 0 };
+	std::atomic<bool> pondering{ false };
+};
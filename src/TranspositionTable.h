@@ -5,9 +5,23 @@
 #include <cassert>
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <climits>
 #include <immintrin.h>
 #include <ammintrin.h>
 
+#if defined(__linux__)
+#include <cstdlib>
+#include <sys/mman.h>
+#elif defined(_MSC_VER)
+#include <malloc.h>
+#else
+#include <cstdlib>
+#endif
+
 #include "Board.h"
 
 
@@ -16,9 +30,11 @@ struct TTEntry
     struct SmpData
     {
         int16_t score;
-        uint8_t depth : 6;
+        uint16_t move;          // Packed with packMove, 0 when there is no move
+        uint8_t depth;
         uint8_t flags : 2;
-        Move move;
+        uint8_t generation : 6; // Search the entry was written in, used to age out entries from earlier moves
+        uint16_t padding;       // Keeps the data at 64 bits for the XOR check
 
         // Convert to a 64-bit integer using std::bit_cast.
         __forceinline uint64_t to_uint64() const 
@@ -74,7 +90,26 @@ struct TTEntry
 
     __forceinline static TTEntry nullEntry()
     {
-        return TTEntry{ 0, { 0, 0, 0, Move{} } };
+        return TTEntry{ 0, { 0, 0, 0, 0, 0, 0 } };
+    }
+
+    // from | to << 6 | promotion type << 12, only as much as is needed to recognise the move among the generated ones
+    __forceinline static uint16_t packMove(const Move& move)
+    {
+        if (move.isNull()) return 0;
+
+        uint16_t promotion = move.promotedPiece == Piece::NONE ? 0 : Piece::getType(move.promotedPiece);
+        return static_cast<uint16_t>(move.startSquare | (move.endSquare << 6) | (promotion << 12));
+    }
+
+    __forceinline static SmpData makeData(int score, int depth, uint8_t flags, const Move& move)
+    {
+        SmpData data{};
+        data.score = static_cast<int16_t>(score);
+        data.move = packMove(move);
+        data.depth = static_cast<uint8_t>(depth);
+        data.flags = flags;
+        return data;
     }
 
     uint64_t smpKey;
@@ -82,47 +117,188 @@ struct TTEntry
 
 };
 
+static_assert(sizeof(TTEntry::SmpData) == sizeof(uint64_t), "SmpData has to fit the 64 bit XOR check");
+
+// One cache line worth of entries, a probe only ever touches a single cluster
+struct alignas(64) TTCluster
+{
+    static constexpr int ENTRY_COUNT = 4;
+
+    TTEntry entries[ENTRY_COUNT];
+};
+
+static_assert(sizeof(TTCluster) == 64, "A cluster has to fill exactly one cache line");
+
 class TranspositionTable
 {
 public:
 	TranspositionTable(size_t tableSizeMB)
-        : nullMove(TTEntry::nullEntry())
+        : table(nullptr), nullMove(TTEntry::nullEntry()), clusterCount(0), generation(0), pageKind(PageKind::Default), explicitHugePages(false)
+    {
+        resize(tableSizeMB);
+    }
+
+	~TranspositionTable()
+    {
+        freeTable();
+    }
+
+    TranspositionTable(const TranspositionTable&) = delete;
+    TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+    // Frees the current table and allocates a new one, the cluster count is rounded down to a power of two.
+    // Must not be called while a search is running
+    void resize(size_t tableSizeMB, size_t threadCount = 1)
     {
 		constexpr size_t MBtoB = 1024ULL * 1024ULL;
-		size_t maxBytes = tableSizeMB * MBtoB;
-        size_t maxEntries = maxBytes / sizeof(TTEntry);
+		size_t maxBytes = std::max<size_t>(1, tableSizeMB) * MBtoB;
+        size_t maxClusters = maxBytes / sizeof(TTCluster);
+
+        freeTable();
+
+        // Halve the request until the allocation succeeds rather than leaving the engine without a table
+        for (size_t clusters = 1ULL << (63 - _lzcnt_u64(maxClusters)); !table && clusters; clusters >>= 1)
+        {
+            clusterCount = clusters;
+            allocateTable();
+        }
 
-        tableEntries = 1ULL << (63 - _lzcnt_u64(maxEntries));
+        if (clusterCount * sizeof(TTCluster) < maxBytes)
+        {
+            std::cerr << "Transposition table allocation of " << tableSizeMB << "MB failed, using " << (clusterCount * sizeof(TTCluster)) / MBtoB << "MB\n";
+        }
 
-        table = new TTEntry[tableEntries];
+        clear(threadCount);
+    }
 
-        std::memset(table, 0, tableEntries * sizeof(TTEntry));
+    // Zeroes the table, large tables are split across threads as touching every page is the slow part
+    void clear(size_t threadCount = 1)
+    {
+        size_t totalBytes = clusterCount * sizeof(TTCluster);
+        threadCount = std::max<size_t>(1, threadCount);
+        generation = 0;
+
+        if (threadCount == 1 || totalBytes < 64ULL * 1024ULL * 1024ULL)
+        {
+            std::memset(table, 0, totalBytes);
+            return;
+        }
+
+        std::vector<std::thread> threads;
+        size_t chunkClusters = clusterCount / threadCount;
+
+        for (size_t i = 0; i < threadCount; ++i)
+        {
+            size_t first = i * chunkClusters;
+            size_t count = (i == threadCount - 1) ? clusterCount - first : chunkClusters;
+
+            threads.emplace_back([this, first, count]() { std::memset(table + first, 0, count * sizeof(TTCluster)); });
+        }
+
+        for (auto& thread : threads) thread.join();
     }
 
-	~TranspositionTable()
+    // Explicit huge pages (MAP_HUGETLB) have to be reserved by the administrator, without them transparent huge pages are requested instead.
+    // Takes effect on the next resize
+    void setExplicitHugePages(bool enabled)
+    {
+        explicitHugePages = enabled;
+    }
+
+    const char* pageSizeDescription() const
+    {
+        switch (pageKind)
+        {
+        case PageKind::ExplicitHuge: return "2MB pages (MAP_HUGETLB)";
+        case PageKind::TransparentHuge: return "2MB pages requested (transparent, madvise)"; // The kernel may still back it with small pages
+        default: return "default pages";
+        }
+    }
+
+    // Permille of a sample of entries that were written during the current search, as reported in the uci hashfull field
+    int hashfull() const
+    {
+        constexpr size_t SAMPLE_CLUSTERS = 1000 / TTCluster::ENTRY_COUNT;
+
+        int used = 0;
+        for (size_t i = 0; i < std::min(SAMPLE_CLUSTERS, clusterCount); ++i)
+        {
+            for (const TTEntry& entry : table[i].entries)
+            {
+                used += entry.smpData.depth != 0 && entry.smpData.generation == generation;
+            }
+        }
+
+        return used * 1000 / static_cast<int>(std::min(SAMPLE_CLUSTERS, clusterCount) * TTCluster::ENTRY_COUNT);
+    }
+
+    size_t sizeMB() const
     {
-        delete[] table;
+        return (clusterCount * sizeof(TTCluster)) / (1024ULL * 1024ULL);
+    }
+
+    // Called once per search (and on ucinewgame), entries written before are aged relative to the new generation
+    void newSearch()
+    {
+        generation = (generation + 1) & GENERATION_MASK;
     }
 
 	__forceinline void store(uint64_t zobristKey, TTEntry::SmpData data)
     {
-        size_t index = zobristKey & (tableEntries - 1);
-		TTEntry& entry = table[index];
+        TTCluster& cluster = table[zobristKey & (clusterCount - 1)];
+        data.generation = generation;
+
+        TTEntry* replace = &cluster.entries[0];
+        int replaceScore = INT_MAX;
+
+        for (TTEntry& entry : cluster.entries)
+        {
+            TTEntry::SmpData entryData = entry.smpData;
+
+            if ((entry.smpKey ^ entryData.to_uint64()) == zobristKey)
+            {
+                // Same position, only keep the old entry if it is a deeper search from this generation
+                if (data.depth < entryData.depth && entryData.generation == generation && data.flags != TTEntry::EXACT) return;
+
+                if (data.move == 0) data.move = entryData.move;
 
-		if (data.depth < entry.smpData.depth) {
-			return;
-		}
+                replace = &entry;
+                break;
+            }
 
-		entry.smpKey = zobristKey ^ data.to_uint64();
-		entry.smpData = data;        
+            // Shallow entries and entries from earlier searches are the cheapest to lose
+            int score = entryData.depth - 8 * relativeAge(entryData.generation);
+            if (score < replaceScore)
+            {
+                replaceScore = score;
+                replace = &entry;
+            }
+        }
+
+		replace->smpKey = zobristKey ^ data.to_uint64();
+		replace->smpData = data;        
+    }
+
+    // Starts pulling the cluster for a key into cache, issue it as soon as the key is known so the miss overlaps with other work
+    __forceinline void prefetch(uint64_t zobristKey) const
+    {
+        _mm_prefetch(reinterpret_cast<const char*>(&table[zobristKey & (clusterCount - 1)]), _MM_HINT_T0);
     }
 
-    __forceinline TTEntry::SmpData& retrieve(uint64_t zobristKey)
+    // Returns a copy, other search threads may overwrite the slot at any time so the key and data are read once and verified together
+    __forceinline TTEntry::SmpData retrieve(uint64_t zobristKey) const
     {
-        size_t index = zobristKey & (tableEntries - 1);
-        if ((table[index].smpKey ^ (table[index].smpData.to_uint64())) == zobristKey)
+        const TTCluster& cluster = table[zobristKey & (clusterCount - 1)];
+
+        for (const TTEntry& entry : cluster.entries)
         {
-			return table[index].smpData; 
+            uint64_t smpKey = entry.smpKey;
+            TTEntry::SmpData smpData = entry.smpData;
+
+            if ((smpKey ^ smpData.to_uint64()) == zobristKey)
+            {
+                return smpData; 
+            }
         }
 
         return nullMove.smpData; // null data
@@ -130,12 +306,99 @@ public:
     
     void printDebugInfo() const
     {
-        std::cout << "Possible Entries: " << tableEntries;
+        std::cout << "Possible Entries: " << clusterCount * TTCluster::ENTRY_COUNT << " - Hashfull: " << hashfull() << " - Backed by " << pageSizeDescription();
     }
     
 	
 private:
-	TTEntry* table;
+    enum class PageKind : uint8_t
+    {
+        Default,
+        TransparentHuge,
+        ExplicitHuge
+    };
+
+    static constexpr size_t HUGE_PAGE_SIZE = 2ULL * 1024ULL * 1024ULL;
+
+    // Tries explicit huge pages, then a 2MB aligned block advised for transparent huge pages, then plain aligned memory.
+    // table is left null if all of them fail
+    void allocateTable()
+    {
+        size_t bytes = clusterCount * sizeof(TTCluster);
+        pageKind = PageKind::Default;
+
+#if defined(__linux__)
+        size_t hugeBytes = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+        if (explicitHugePages)
+        {
+            void* mem = mmap(nullptr, hugeBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (mem != MAP_FAILED)
+            {
+                table = static_cast<TTCluster*>(mem);
+                pageKind = PageKind::ExplicitHuge;
+                return;
+            }
+        }
+
+        table = static_cast<TTCluster*>(std::aligned_alloc(HUGE_PAGE_SIZE, hugeBytes));
+        if (table && madvise(table, hugeBytes, MADV_HUGEPAGE) == 0 && transparentHugePagesEnabled())
+        {
+            pageKind = PageKind::TransparentHuge;
+        }
+#elif defined(_MSC_VER)
+        // Large pages on Windows need the SeLockMemoryPrivilege, so plain aligned memory is used
+        table = static_cast<TTCluster*>(_aligned_malloc(bytes, alignof(TTCluster)));
+#else
+        table = static_cast<TTCluster*>(std::aligned_alloc(alignof(TTCluster), bytes));
+#endif
+    }
+
+#if defined(__linux__)
+    // madvise succeeds even when transparent huge pages are switched off, the active mode is the one in brackets
+    static bool transparentHugePagesEnabled()
+    {
+        std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+        std::string modes;
+        std::getline(file, modes);
+        return modes.find("[always]") != std::string::npos || modes.find("[madvise]") != std::string::npos;
+    }
+#endif
+
+    void freeTable()
+    {
+        if (!table) return;
+
+#if defined(__linux__)
+        if (pageKind == PageKind::ExplicitHuge)
+        {
+            size_t hugeBytes = (clusterCount * sizeof(TTCluster) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+            munmap(table, hugeBytes);
+        }
+        else
+        {
+            std::free(table);
+        }
+#elif defined(_MSC_VER)
+        _aligned_free(table);
+#else
+        std::free(table);
+#endif
+
+        table = nullptr;
+    }
+
+    static constexpr uint8_t GENERATION_MASK = 0x3F; // Generation is stored in 6 bits
+
+    __forceinline int relativeAge(uint8_t entryGeneration) const
+    {
+        return (generation - entryGeneration) & GENERATION_MASK;
+    }
+
+	TTCluster* table;
     TTEntry nullMove;
-	size_t tableEntries;
+	size_t clusterCount;
+    uint8_t generation;
+    PageKind pageKind;
+    bool explicitHugePages;
 };
@@ -6,6 +6,7 @@
 BoardState UCI::board;
 MoveGenerator UCI::moveGen;
 Searcher UCI::searcher;
+std::thread UCI::searchThread;
 bool UCI::uciMode = false;
 bool UCI::debugMode = false;
 
@@ -15,6 +16,8 @@ void UCI::loop() {
     while (std::getline(std::cin, line)) {
         processCommand(line);
     }
+
+    stopSearch();
 }
 
 void UCI::processCommand(const std::string& command) {
@@ -43,8 +46,21 @@ void UCI::processCommand(const std::string& command) {
         uciMode = true;
         std::cout << "id name ChessEngineV4\n";
         std::cout << "Bennett Friesen\n";
+        std::cout << "option name Hash type spin default " << Searcher::DEFAULT_HASH_MB << " min 1 max " << Searcher::MAX_HASH_MB << "\n";
+        std::cout << "option name Threads type spin default " << searcher.threadCount() << " min 1 max " << Searcher::MAX_THREADS << "\n";
+        std::cout << "option name LargePages type check default false\n";
+        std::cout << "option name Ponder type check default false\n";
+        std::cout << "option name SearchLog type check default false\n";
         std::cout << "uciok\n";
     }
+    else if (token == "setoption") {
+        stopSearch();
+        setOption(command);
+    }
+    else if (token == "ucinewgame") {
+        stopSearch();
+        searcher.newGame();
+    }
     else if (token == "isready") {
         std::cout << "readyok\n";
     }
@@ -81,16 +97,67 @@ void UCI::processCommand(const std::string& command) {
             return;
         }
 
+        stopSearch();
         setupPosition(fen, moves);
     }
     else if (token == "go") {
-        startSearch(command.substr(3));
+        stopSearch();
+        startSearch(command);
+    }
+    else if (token == "stop") {
+        stopSearch();
+    }
+    else if (token == "ponderhit") {
+        searcher.ponderhit();
     }
     else if (token == "quit") {
+        stopSearch();
         exit(0);
     }
 }
 
+void UCI::setOption(const std::string& command) {
+    // setoption name <id> [value <x>], the name itself may contain spaces
+    std::istringstream iss(command);
+    std::string token, name, value;
+    iss >> token; // "setoption"
+
+    while (iss >> token && token != "name") {}
+    while (iss >> token && token != "value") {
+        name += (name.empty() ? "" : " ") + token;
+    }
+    while (iss >> token) {
+        value += (value.empty() ? "" : " ") + token;
+    }
+
+    try {
+        if (name == "Hash") {
+            searcher.setHashSize(std::stoull(value));
+            if (UCI::debugMode) std::cout << "info string Hash set to " << searcher.hashSizeMB() << "MB backed by " << searcher.hashPageSize() << "\n";
+        }
+        else if (name == "Threads") {
+            searcher.setThreadCount(std::stoull(value));
+            if (UCI::debugMode) std::cout << "info string Threads set to " << searcher.threadCount() << "\n";
+        }
+        else if (name == "LargePages") {
+            searcher.setLargePages(value == "true");
+            if (UCI::debugMode) std::cout << "info string Hash backed by " << searcher.hashPageSize() << "\n";
+        }
+        else if (name == "SearchLog") {
+            searcher.setSearchLog(value == "true");
+        }
+        else if (name == "Ponder") {
+            // Only tells us the GUI may send "go ponder", nothing to configure
+        }
+        else {
+            std::cout << "info string Unknown option " << name << "\n";
+        }
+    }
+    catch (const std::exception&) {
+        std::cout << "info string Invalid value for option " << name << "\n";
+    }
+}
+
 void UCI::setupPosition(const std::string& fen, const std::vector<std::string>& moves) {
 
     if (fen.find("startpos") != std::string::npos) {
@@ -119,28 +186,59 @@ void UCI::setupPosition(const std::string& fen, const std::vector<std::string>&
 
 
 void UCI::startSearch(const std::string& parameters) {
-    int timeLimit = 1000; 
-    int depth = 100;
+    // go [ponder] [wtime <x>] [btime <x>] [winc <x>] [binc <x>] [movestogo <x>] [movetime <x>] [depth <x>] [nodes <x>] [infinite]
+    SearchLimits limits;
 
-	std::istringstream iss(parameters);
+    std::istringstream iss(parameters);
     std::string token;
 
-    while (iss >> token)
-    {
-        if (token == "movetime")
-        {
-            iss >> token;
-        }
-        else if (token == "depth")
+    try {
+        while (iss >> token)
         {
-            iss >> token;
-            //depth = std::stoi(token);
+            if (token == "wtime") { iss >> token; limits.time[0] = std::stoll(token); }
+            else if (token == "btime") { iss >> token; limits.time[1] = std::stoll(token); }
+            else if (token == "winc") { iss >> token; limits.increment[0] = std::stoll(token); }
+            else if (token == "binc") { iss >> token; limits.increment[1] = std::stoll(token); }
+            else if (token == "movestogo") { iss >> token; limits.movesToGo = std::stoi(token); }
+            else if (token == "movetime") { iss >> token; limits.moveTime = std::stoll(token); }
+            else if (token == "depth") { iss >> token; limits.depth = std::stoi(token); }
+            else if (token == "nodes") { iss >> token; limits.nodes = std::stoull(token); }
+            else if (token == "infinite") { limits.infinite = true; }
+            else if (token == "ponder") { limits.ponder = true; }
         }
     }
+    catch (const std::exception&) {
+        std::cout << "info string Invalid go command\n";
+        return;
+    }
 
-    std::string bestMove = moveToUCI(searcher.findBestMove(board, depth, timeLimit));
-    
-    std::cout << "bestmove " << bestMove << "\n";
+    // A bare "go" with no clock, movetime, depth or node limit falls back to the old fixed time per move
+    bool hasClock = limits.time[board.whiteTurn ? 0 : 1] >= 0;
+    if (!limits.infinite && limits.moveTime < 0 && !hasClock && limits.depth == 0 && limits.nodes == 0) {
+        limits.moveTime = DEFAULT_MOVE_TIME;
+    }
+
+    // The search gets its own copy of the board, the input loop only waits for it before changing the position again
+    searcher.prepareSearch(limits, board.whiteTurn);
+    searchThread = std::thread([searchBoard = board, limits]() mutable {
+        // A position without legal moves still gets an answer, "0000" is the uci null move
+        Move move = searcher.runPreparedSearch(searchBoard, limits);
+        std::string bestMove = "bestmove " + (move.isNull() ? std::string("0000") : moveToUCI(move));
+
+        Move ponderMove = searcher.ponderMove();
+        if (!ponderMove.isNull()) bestMove += " ponder " + moveToUCI(ponderMove);
+
+        // The input loop is blocked reading stdin, nothing else would flush the output
+        std::cout << bestMove << std::endl;
+    });
+}
+
+void UCI::stopSearch() {
+    // Also ends a ponder or infinite search, which would otherwise hold back its best move forever
+    if (!searchThread.joinable()) return;
+
+    searcher.stop();
+    searchThread.join();
 }
 
 void UCI::printBoard(const BoardState& board) {
@@ -148,21 +246,13 @@ void UCI::printBoard(const BoardState& board) {
         std::string rankStr;
         for (int file = 0; file < 8; ++file) {
             const int square = rank * 8 + file;
-            const Bitboard mask = 1ULL << square;
+            const uint8_t occupant = board.pieceOn(square);
             char piece = '.';
 
-            if (board.whiteKing & mask)        piece = 'K';
-            else if (board.blackKing & mask)   piece = 'k';
-            else if (board.whiteQueens & mask) piece = 'Q';
-            else if (board.blackQueens & mask) piece = 'q';
-            else if (board.whiteRooks & mask)  piece = 'R';
-            else if (board.blackRooks & mask)  piece = 'r';
-            else if (board.whiteBishops & mask)piece = 'B';
-            else if (board.blackBishops & mask)piece = 'b';
-            else if (board.whiteKnights & mask)piece = 'N';
-            else if (board.blackKnights & mask)piece = 'n';
-            else if (board.whitePawns & mask)  piece = 'P';
-            else if (board.blackPawns & mask)  piece = 'p';
+            if (occupant != Piece::NONE) {
+                piece = "PNBRQK"[Piece::getType(occupant)];
+                if (Piece::getColor(occupant)) piece = static_cast<char>(std::tolower(piece));
+            }
 
             rankStr += piece;
             rankStr += ' ';
@@ -3,20 +3,26 @@
 #include "MoveGenerator.h"
 #include "Search.h"
 #include <string>
+#include <thread>
 
 class UCI {
 public:
     static void loop();
     static void processCommand(const std::string& command);
+    static void setOption(const std::string& command);
     static void setupPosition(const std::string& fen, const std::vector<std::string>& moves);
     static void startSearch(const std::string& parameters);
+    static void stopSearch();
     static void printBoard(const BoardState& board);
 
 private:
+    static constexpr int64_t DEFAULT_MOVE_TIME = 1000; // Used when "go" gives no limit at all
+
     static BoardState board;
     static MoveGenerator moveGen;
     static bool uciMode;
     static bool debugMode;
     static Searcher searcher;
+    static std::thread searchThread; // Runs one "go" at a time so the input loop stays responsive
 };
 		